@@ -6,6 +6,8 @@
 #include "allowedips.h"
 #include "peer.h"
 
+#include <linux/sort.h>
+
 enum { MAX_ALLOWEDIPS_BITS = 128 };
 
 static struct kmem_cache *node_cache;
@@ -123,18 +125,358 @@ static struct allowedips_node *find_node(struct allowedips_node *trie, u8 bits,
 	return found;
 }
 
-/* Returns a strong reference to a peer */
-static struct wg_peer *lookup(struct allowedips_node __rcu *root, u8 bits,
-			      const void *be_ip)
+enum {
+	ALLOWEDIPS_STRIDE = 6,
+	ALLOWEDIPS_STRIDE_DEPTH = DIV_ROUND_UP(MAX_ALLOWEDIPS_BITS, ALLOWEDIPS_STRIDE),
+	/* Past this, the trie alone is a better deal than the copy. */
+	ALLOWEDIPS_STRIDE_MAX_NODES = 1U << 20
+};
+
+/* Bits [off, off + len) of the address, counted from the most significant
+ * one. hi:lo is the host endian address as produced by swap_endian(), with
+ * IPv4 addresses placed in the top 32 bits of hi.
+ */
+static inline unsigned int stride_chunk(u64 hi, u64 lo, unsigned int off,
+					unsigned int len)
+{
+	u64 word;
+
+	if (off < 64)
+		word = (hi << off) | (off ? lo >> (64 - off) : 0);
+	else
+		word = lo << (off - 64);
+	return word >> (64 - len);
+}
+
+static inline void stride_key(const u8 *ip, u8 bits, u64 *hi, u64 *lo)
+{
+	if (bits == 32) {
+		*hi = (u64)*(const u32 *)ip << 32;
+		*lo = 0;
+	} else {
+		*hi = ((const u64 *)ip)[0];
+		*lo = ((const u64 *)ip)[1];
+	}
+}
+
+static struct wg_peer *stride_find(const struct allowedips_stride_table *st,
+				   u8 bits, u64 hi, u64 lo)
+{
+	const struct allowedips_stride *node = st->nodes;
+	unsigned int off = 0, len, chunk;
+
+	for (;;) {
+		len = min_t(unsigned int, ALLOWEDIPS_STRIDE, bits - off);
+		chunk = stride_chunk(hi, lo, off, len);
+		if (!(node->child_map & BIT_ULL(chunk)))
+			break;
+		node = &st->nodes[node->child_base +
+				  hweight64(node->child_map & (BIT_ULL(chunk) - 1))];
+		off += len;
+	}
+	return st->leaves[node->leaf_base +
+			  hweight64(node->leaf_map & ((BIT_ULL(chunk) << 1) - 1)) - 1];
+}
+
+static void stride_table_free(struct allowedips_stride_table *st)
+{
+	kvfree(st->nodes);
+	kvfree(st->leaves);
+	kfree(st);
+}
+
+static void stride_table_free_rcu(struct rcu_head *rcu)
+{
+	stride_table_free(container_of(rcu, struct allowedips_stride_table, rcu));
+}
+
+static void stride_table_drop(struct allowedips_stride_table __rcu **slot,
+			      struct mutex *lock)
+{
+	struct allowedips_stride_table *st =
+		rcu_dereference_protected(*slot, lockdep_is_held(lock));
+
+	if (!st)
+		return;
+	RCU_INIT_POINTER(*slot, NULL);
+	call_rcu(&st->rcu, stride_table_free_rcu);
+}
+
+struct stride_prefix {
+	u64 hi, lo;
+	struct wg_peer *peer;
+	u8 cidr;
+};
+
+struct stride_builder {
+	struct stride_prefix *prefixes;
+	struct allowedips_stride *nodes;
+	struct wg_peer **leaves;
+	u32 nr_nodes, max_nodes;
+	u32 nr_leaves, max_leaves;
+	u8 bits;
+	/* Per level scratch, so that the recursion stays light on stack. */
+	struct wg_peer *best[ALLOWEDIPS_STRIDE_DEPTH][1U << ALLOWEDIPS_STRIDE];
+	u8 best_cidr[ALLOWEDIPS_STRIDE_DEPTH][1U << ALLOWEDIPS_STRIDE];
+};
+
+static int stride_prefix_cmp(const void *a, const void *b)
+{
+	const struct stride_prefix *x = a, *y = b;
+
+	if (x->hi != y->hi)
+		return x->hi < y->hi ? -1 : 1;
+	if (x->lo != y->lo)
+		return x->lo < y->lo ? -1 : 1;
+	return x->cidr - y->cidr;
+}
+
+static int stride_grow(void **array, u32 *max, u32 want, size_t size)
+{
+	u32 new_max = max(*max * 2, want);
+	void *p;
+
+	if (want <= *max)
+		return 0;
+	p = kvrealloc(*array, *max * size, new_max * size, GFP_KERNEL);
+	if (!p)
+		return -ENOMEM;
+	*array = p;
+	*max = new_max;
+	return 0;
+}
+
+/* Fills in nodes[idx] from the sorted prefixes [start, end), which all share
+ * their leading depth * ALLOWEDIPS_STRIDE bits, pushing the best match found
+ * so far (inherited) down into the leaves. Recursion is bounded by
+ * ALLOWEDIPS_STRIDE_DEPTH.
+ */
+static int stride_build(struct stride_builder *b, u32 idx, size_t start,
+			size_t end, unsigned int depth, struct wg_peer *inherited)
+{
+	const unsigned int off = depth * ALLOWEDIPS_STRIDE;
+	const unsigned int len = min_t(unsigned int, ALLOWEDIPS_STRIDE, b->bits - off);
+	struct wg_peer **best = b->best[depth], *last = NULL;
+	u8 *best_cidr = b->best_cidr[depth];
+	u64 child_map = 0, leaf_map = 0;
+	u32 child_base, leaf_base;
+	unsigned int chunk, j;
+	size_t i, k;
+	int ret;
+
+	for (chunk = 0; chunk < (1U << len); ++chunk) {
+		best[chunk] = inherited;
+		best_cidr[chunk] = 0;
+	}
+
+	for (i = start; i < end; ++i) {
+		const struct stride_prefix *p = &b->prefixes[i];
+
+		if (p->cidr <= off)
+			continue;
+		chunk = stride_chunk(p->hi, p->lo, off, len);
+		if (p->cidr > off + len) {
+			child_map |= BIT_ULL(chunk);
+			continue;
+		}
+		/* The key is masked, so chunk is aligned to the span. */
+		for (j = chunk; j < chunk + (1U << (off + len - p->cidr)); ++j) {
+			if (best_cidr[j] < p->cidr) {
+				best[j] = p->peer;
+				best_cidr[j] = p->cidr;
+			}
+		}
+	}
+
+	leaf_base = b->nr_leaves;
+	for (chunk = 0; chunk < (1U << len); ++chunk) {
+		if (child_map & BIT_ULL(chunk))
+			continue;
+		if (b->nr_leaves != leaf_base && best[chunk] == last)
+			continue;
+		ret = stride_grow((void **)&b->leaves, &b->max_leaves,
+				  b->nr_leaves + 1, sizeof(*b->leaves));
+		if (ret)
+			return ret;
+		b->leaves[b->nr_leaves++] = last = best[chunk];
+		leaf_map |= BIT_ULL(chunk);
+	}
+
+	child_base = b->nr_nodes;
+	b->nr_nodes += hweight64(child_map);
+	if (b->nr_nodes > ALLOWEDIPS_STRIDE_MAX_NODES)
+		return -E2BIG;
+	ret = stride_grow((void **)&b->nodes, &b->max_nodes, b->nr_nodes,
+			  sizeof(*b->nodes));
+	if (ret)
+		return ret;
+	b->nodes[idx] = (struct allowedips_stride){
+		.child_map = child_map,
+		.leaf_map = leaf_map,
+		.child_base = child_base,
+		.leaf_base = leaf_base
+	};
+
+	for (i = start; i < end; i = k) {
+		const struct stride_prefix *p = &b->prefixes[i];
+
+		chunk = stride_chunk(p->hi, p->lo, off, len);
+		for (k = i + 1; k < end; ++k) {
+			p = &b->prefixes[k];
+			if (stride_chunk(p->hi, p->lo, off, len) != chunk)
+				break;
+		}
+		if (!(child_map & BIT_ULL(chunk)))
+			continue;
+		ret = stride_build(b, child_base +
+				   hweight64(child_map & (BIT_ULL(chunk) - 1)),
+				   i, k, depth + 1, best[chunk]);
+		if (ret)
+			return ret;
+	}
+	return 0;
+}
+
+static int stride_table_build(struct allowedips_node __rcu *root, u8 bits,
+			      struct allowedips_stride_table **rst,
+			      struct mutex *lock)
+{
+	struct allowedips_node *node, *stack[MAX_ALLOWEDIPS_BITS] = {
+		rcu_dereference_protected(root, lockdep_is_held(lock)) };
+	struct allowedips_stride_table *st = NULL;
+	struct wg_peer *inherited = NULL;
+	struct stride_builder *b;
+	unsigned int len = 1;
+	size_t nr = 0, max = 64;
+	int ret = -ENOMEM;
+
+	*rst = NULL;
+	if (!stack[0])
+		return 0;
+
+	b = kzalloc(sizeof(*b), GFP_KERNEL);
+	if (!b)
+		return -ENOMEM;
+	b->bits = bits;
+	b->prefixes = kvmalloc_array(max, sizeof(*b->prefixes), GFP_KERNEL);
+	if (!b->prefixes)
+		goto out;
+
+	while (len > 0 && (node = stack[--len])) {
+		u8 ip[16] __aligned(__alignof(u64));
+		struct stride_prefix *p;
+		u64 mask;
+
+		push_rcu(stack, node->bit[0], &len);
+		push_rcu(stack, node->bit[1], &len);
+		if (!rcu_access_pointer(node->peer))
+			continue;
+		if (!node->cidr) {
+			inherited = rcu_dereference_protected(node->peer,
+							      lockdep_is_held(lock));
+			continue;
+		}
+		if (nr == max) {
+			void *n = kvrealloc(b->prefixes, max * sizeof(*p),
+					    2 * max * sizeof(*p), GFP_KERNEL);
+
+			if (!n)
+				goto out;
+			b->prefixes = n;
+			max *= 2;
+		}
+		p = &b->prefixes[nr++];
+		memcpy(ip, node->bits, bits / 8U);
+		stride_key(ip, bits, &p->hi, &p->lo);
+		mask = ~0ULL << (64 - min_t(unsigned int, node->cidr, 64));
+		p->hi &= mask;
+		p->lo &= node->cidr > 64 ? ~0ULL << (128 - node->cidr) : 0;
+		p->cidr = node->cidr;
+		p->peer = rcu_dereference_protected(node->peer,
+						    lockdep_is_held(lock));
+	}
+	sort(b->prefixes, nr, sizeof(*b->prefixes), stride_prefix_cmp, NULL);
+
+	ret = stride_grow((void **)&b->nodes, &b->max_nodes, 64,
+			  sizeof(*b->nodes));
+	if (ret)
+		goto out;
+	b->nr_nodes = 1;
+	ret = stride_build(b, 0, 0, nr, 0, inherited);
+	if (ret)
+		goto out;
+
+	ret = -ENOMEM;
+	st = kzalloc(sizeof(*st), GFP_KERNEL);
+	if (!st)
+		goto out;
+	st->nodes = b->nodes;
+	st->leaves = b->leaves;
+	b->nodes = NULL;
+	b->leaves = NULL;
+	*rst = st;
+	ret = 0;
+out:
+	kvfree(b->nodes);
+	kvfree(b->leaves);
+	kvfree(b->prefixes);
+	kfree(b);
+	return ret;
+}
+
+/* Rebuilds the stride tables that were invalidated by updates since the last
+ * call. Lookups use the tries until this is done, and keep doing so for a
+ * family whose table could not be built.
+ */
+int wg_allowedips_compress(struct allowedips *table, struct mutex *lock)
+{
+	struct allowedips_stride_table *st;
+	int ret = 0, err;
+
+	if (!rcu_access_pointer(table->stride4)) {
+		err = stride_table_build(table->root4, 32, &st, lock);
+		if (!err)
+			rcu_assign_pointer(table->stride4, st);
+		else
+			ret = err;
+	}
+	if (!rcu_access_pointer(table->stride6)) {
+		err = stride_table_build(table->root6, 128, &st, lock);
+		if (!err)
+			rcu_assign_pointer(table->stride6, st);
+		else
+			ret = err;
+	}
+	return ret;
+}
+
+/* Returns a strong reference to a peer. Must be called with rcu_read_lock_bh
+ * held; stride may be NULL, in which case only the trie is used.
+ */
+static struct wg_peer *__lookup(struct allowedips_node __rcu *root,
+				struct allowedips_stride_table __rcu *stride,
+				u8 bits, const void *be_ip)
 {
 	/* Aligned so it can be passed to fls/fls64 */
 	u8 ip[16] __aligned(__alignof(u64));
+	struct allowedips_stride_table *st;
 	struct allowedips_node *node;
 	struct wg_peer *peer = NULL;
+	u64 hi, lo;
 
 	swap_endian(ip, be_ip, bits);
 
-	rcu_read_lock_bh();
+	st = rcu_dereference_bh(stride);
+	if (st) {
+		stride_key(ip, bits, &hi, &lo);
+		peer = stride_find(st, bits, hi, lo);
+		/* A peer on its way out was already removed from the trie,
+		 * which, unlike the stride table, is updated in place.
+		 */
+		if (!peer || (peer = wg_peer_get_maybe_zero(peer)))
+			return peer;
+	}
+
 retry:
 	node = find_node(rcu_dereference_bh(root), bits, ip);
 	if (node) {
@@ -142,6 +484,18 @@ static struct wg_peer *lookup(struct allowedips_node __rcu *root, u8 bits,
 		if (!peer)
 			goto retry;
 	}
+	return peer;
+}
+
+/* Returns a strong reference to a peer */
+static struct wg_peer *lookup(struct allowedips_node __rcu *root,
+			      struct allowedips_stride_table __rcu *stride,
+			      u8 bits, const void *be_ip)
+{
+	struct wg_peer *peer;
+
+	rcu_read_lock_bh();
+	peer = __lookup(root, stride, bits, be_ip);
 	rcu_read_unlock_bh();
 	return peer;
 }
@@ -252,6 +606,7 @@ static int add(struct allowedips_node __rcu **trie, u8 bits, const u8 *key,
 void wg_allowedips_init(struct allowedips *table)
 {
 	table->root4 = table->root6 = NULL;
+	table->stride4 = table->stride6 = NULL;
 	table->seq = 1;
 }
 
@@ -260,6 +615,8 @@ void wg_allowedips_free(struct allowedips *table, struct mutex *lock)
 	struct allowedips_node __rcu *old4 = table->root4, *old6 = table->root6;
 
 	++table->seq;
+	stride_table_drop(&table->stride4, lock);
+	stride_table_drop(&table->stride6, lock);
 	RCU_INIT_POINTER(table->root4, NULL);
 	RCU_INIT_POINTER(table->root6, NULL);
 	if (rcu_access_pointer(old4)) {
@@ -285,6 +642,7 @@ int wg_allowedips_insert_v4(struct allowedips *table, const struct in_addr *ip,
 	u8 key[4] __aligned(__alignof(u32));
 
 	++table->seq;
+	stride_table_drop(&table->stride4, lock);
 	swap_endian(key, (const u8 *)ip, 32);
 	return add(&table->root4, 32, key, cidr, peer, lock);
 }
@@ -296,6 +654,7 @@ int wg_allowedips_insert_v6(struct allowedips *table, const struct in6_addr *ip,
 	u8 key[16] __aligned(__alignof(u64));
 
 	++table->seq;
+	stride_table_drop(&table->stride6, lock);
 	swap_endian(key, (const u8 *)ip, 128);
 	return add(&table->root6, 128, key, cidr, peer, lock);
 }
@@ -309,6 +668,8 @@ void wg_allowedips_remove_by_peer(struct allowedips *table,
 	if (list_empty(&peer->allowedips_list))
 		return;
 	++table->seq;
+	stride_table_drop(&table->stride4, lock);
+	stride_table_drop(&table->stride6, lock);
 	list_for_each_entry_safe(node, tmp, &peer->allowedips_list, peer_list) {
 		list_del_init(&node->peer_list);
 		RCU_INIT_POINTER(node->peer, NULL);
@@ -357,9 +718,11 @@ struct wg_peer *wg_allowedips_lookup_dst(struct allowedips *table,
 					 struct sk_buff *skb)
 {
 	if (skb->protocol == htons(ETH_P_IP))
-		return lookup(table->root4, 32, &ip_hdr(skb)->daddr);
+		return lookup(table->root4, table->stride4, 32,
+			      &ip_hdr(skb)->daddr);
 	else if (skb->protocol == htons(ETH_P_IPV6))
-		return lookup(table->root6, 128, &ipv6_hdr(skb)->daddr);
+		return lookup(table->root6, table->stride6, 128,
+			      &ipv6_hdr(skb)->daddr);
 	return NULL;
 }
 
@@ -368,12 +731,39 @@ struct wg_peer *wg_allowedips_lookup_src(struct allowedips *table,
 					 struct sk_buff *skb)
 {
 	if (skb->protocol == htons(ETH_P_IP))
-		return lookup(table->root4, 32, &ip_hdr(skb)->saddr);
+		return lookup(table->root4, table->stride4, 32,
+			      &ip_hdr(skb)->saddr);
 	else if (skb->protocol == htons(ETH_P_IPV6))
-		return lookup(table->root6, 128, &ipv6_hdr(skb)->saddr);
+		return lookup(table->root6, table->stride6, 128,
+			      &ipv6_hdr(skb)->saddr);
 	return NULL;
 }
 
+/* Like wg_allowedips_lookup_src() for each of the n packets, under a single
+ * RCU read side section. peers[i] is a strong reference or NULL.
+ */
+void wg_allowedips_lookup_src_batch(struct allowedips *table,
+				    struct sk_buff **skbs,
+				    struct wg_peer **peers, unsigned int n)
+{
+	unsigned int i;
+
+	rcu_read_lock_bh();
+	for (i = 0; i < n; ++i) {
+		struct sk_buff *skb = skbs[i];
+
+		if (skb->protocol == htons(ETH_P_IP))
+			peers[i] = __lookup(table->root4, table->stride4, 32,
+					    &ip_hdr(skb)->saddr);
+		else if (skb->protocol == htons(ETH_P_IPV6))
+			peers[i] = __lookup(table->root6, table->stride6, 128,
+					    &ipv6_hdr(skb)->saddr);
+		else
+			peers[i] = NULL;
+	}
+	rcu_read_unlock_bh();
+}
+
 int __init wg_allowedips_slab_init(void)
 {
 	node_cache = KMEM_CACHE(allowedips_node, 0);
@@ -26,10 +26,30 @@ struct allowedips_node {
 	};
 };
 
+/* A read-only multibit copy of a trie, rebuilt by wg_allowedips_compress().
+ * Each node consumes ALLOWEDIPS_STRIDE bits of the address; child and leaf
+ * arrays are indexed by popcount of the bitmaps below the chunk value.
+ */
+struct allowedips_stride {
+	u64 child_map;	/* chunk values that descend to a child node */
+	u64 leaf_map;	/* chunk values starting a new run of leaves */
+	u32 child_base;
+	u32 leaf_base;
+};
+
+struct allowedips_stride_table {
+	struct allowedips_stride *nodes;
+	struct wg_peer **leaves;
+	struct rcu_head rcu;
+};
+
 struct allowedips {
 	struct allowedips_node __rcu *root4;
 	struct allowedips_node __rcu *root6;
 	u64 seq;
+	/* NULL while stale, the tries are authoritative. */
+	struct allowedips_stride_table __rcu *stride4;
+	struct allowedips_stride_table __rcu *stride6;
 } __aligned(4); /* We pack the lower 2 bits of &root, but m68k only gives 16-bit alignment. */
 
 void wg_allowedips_init(struct allowedips *table);
@@ -42,12 +62,16 @@ void wg_allowedips_remove_by_peer(struct allowedips *table,
 				  struct wg_peer *peer, struct mutex *lock);
 /* The ip input pointer should be __aligned(__alignof(u64))) */
 int wg_allowedips_read_node(struct allowedips_node *node, u8 ip[16], u8 *cidr);
+int wg_allowedips_compress(struct allowedips *table, struct mutex *lock);
 
 /* These return a strong reference to a peer: */
 struct wg_peer *wg_allowedips_lookup_dst(struct allowedips *table,
 					 struct sk_buff *skb);
 struct wg_peer *wg_allowedips_lookup_src(struct allowedips *table,
 					 struct sk_buff *skb);
+void wg_allowedips_lookup_src_batch(struct allowedips *table,
+				    struct sk_buff **skbs,
+				    struct wg_peer **peers, unsigned int n);
 
 #ifdef DEBUG
 bool wg_allowedips_selftest(void);
@@ -50,6 +50,7 @@ enum limits {
 	MAX_TIMER_HANDSHAKES = 90 / REKEY_TIMEOUT,
 	MAX_QUEUED_INCOMING_HANDSHAKES = 4096, /* TODO: replace this with DQL */
 	MAX_STAGED_PACKETS = 128,
+	MAX_BUNDLE_PACKETS = 16,
 	MAX_QUEUED_PACKETS = 1024 /* TODO: replace this with DQL */
 };
 
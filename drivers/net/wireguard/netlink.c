@@ -593,6 +593,8 @@ static int wg_set_device(struct sk_buff *skb, struct genl_info *info)
 	ret = 0;
 
 out:
+	/* Failing to compress just leaves lookups on the tries. */
+	wg_allowedips_compress(&wg->peer_allowedips, &wg->device_update_lock);
 	mutex_unlock(&wg->device_update_lock);
 	rtnl_unlock();
 	dev_put(wg->dev);
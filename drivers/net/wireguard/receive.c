@@ -332,13 +332,59 @@ static bool counter_validate(struct noise_replay_counter *counter, u64 their_cou
 
 #include "selftest/counter.c"
 
-static void wg_packet_consume_data_done(struct wg_peer *peer,
+/* Decrypted packets of one NAPI poll whose source address still has to be
+ * checked against the allowed IPs of the peer. They are looked up together
+ * and then handed to GRO in the order they arrived.
+ */
+struct rx_batch {
+	struct sk_buff *skbs[16];
+	unsigned int lens[16];
+	unsigned int n;
+};
+
+static void wg_packet_route_batch(struct wg_peer *peer, struct rx_batch *batch)
+{
+	struct net_device *dev = peer->device->dev;
+	struct wg_peer *routed_peers[ARRAY_SIZE(batch->skbs)];
+	unsigned int i;
+
+	wg_allowedips_lookup_src_batch(&peer->device->peer_allowedips,
+				       batch->skbs, routed_peers, batch->n);
+
+	for (i = 0; i < batch->n; ++i) {
+		struct sk_buff *skb = batch->skbs[i];
+
+		/* We don't need the extra reference. */
+		wg_peer_put(routed_peers[i]);
+
+		if (unlikely(routed_peers[i] != peer)) {
+			net_dbg_skb_ratelimited("%s: Packet has unallowed src IP (%pISc) from peer %llu (%pISpfsc)\n",
+						dev->name, skb,
+						peer->internal_id,
+						&peer->endpoint.addr);
+			++dev->stats.rx_errors;
+			++dev->stats.rx_frame_errors;
+			dev_kfree_skb(skb);
+			continue;
+		}
+
+		napi_gro_receive(&peer->napi, skb);
+		update_rx_stats(peer, message_data_len(batch->lens[i]));
+	}
+	batch->n = 0;
+}
+
+/* Returns true if the packet carried data, false for keepalives. The timers
+ * are updated by the caller, once per batch. Packets that pass the checks
+ * here are queued on @batch for wg_packet_route_batch().
+ */
+static bool wg_packet_consume_data_done(struct wg_peer *peer,
 					struct sk_buff *skb,
-					struct endpoint *endpoint)
+					struct endpoint *endpoint,
+					struct rx_batch *batch)
 {
 	struct net_device *dev = peer->device->dev;
 	unsigned int len, len_before_trim;
-	struct wg_peer *routed_peer;
 
 	wg_socket_set_peer_endpoint(peer, endpoint);
 
@@ -348,22 +394,16 @@ static void wg_packet_consume_data_done(struct wg_peer *peer,
 		wg_packet_send_staged_packets(peer);
 	}
 
-	keep_key_fresh(peer);
-
-	wg_timers_any_authenticated_packet_received(peer);
-	wg_timers_any_authenticated_packet_traversal(peer);
-
 	/* A packet with length 0 is a keepalive packet */
 	if (unlikely(!skb->len)) {
 		update_rx_stats(peer, message_data_len(0));
 		net_dbg_ratelimited("%s: Receiving keepalive packet from peer %llu (%pISpfsc)\n",
 				    dev->name, peer->internal_id,
 				    &peer->endpoint.addr);
-		goto packet_processed;
+		dev_kfree_skb(skb);
+		return false;
 	}
 
-	wg_timers_data_received(peer);
-
 	if (unlikely(skb_network_header(skb) < skb->head))
 		goto dishonest_packet_size;
 	if (unlikely(!(pskb_network_may_pull(skb, sizeof(struct iphdr)) &&
@@ -401,24 +441,12 @@ static void wg_packet_consume_data_done(struct wg_peer *peer,
 	if (unlikely(pskb_trim(skb, len)))
 		goto packet_processed;
 
-	routed_peer = wg_allowedips_lookup_src(&peer->device->peer_allowedips,
-					       skb);
-	wg_peer_put(routed_peer); /* We don't need the extra reference. */
-
-	if (unlikely(routed_peer != peer))
-		goto dishonest_packet_peer;
-
-	napi_gro_receive(&peer->napi, skb);
-	update_rx_stats(peer, message_data_len(len_before_trim));
-	return;
+	batch->skbs[batch->n] = skb;
+	batch->lens[batch->n] = len_before_trim;
+	if (++batch->n == ARRAY_SIZE(batch->skbs))
+		wg_packet_route_batch(peer, batch);
+	return true;
 
-dishonest_packet_peer:
-	net_dbg_skb_ratelimited("%s: Packet has unallowed src IP (%pISc) from peer %llu (%pISpfsc)\n",
-				dev->name, skb, peer->internal_id,
-				&peer->endpoint.addr);
-	++dev->stats.rx_errors;
-	++dev->stats.rx_frame_errors;
-	goto packet_processed;
 dishonest_packet_type:
 	net_dbg_ratelimited("%s: Packet is neither ipv4 nor ipv6 from peer %llu (%pISpfsc)\n",
 			    dev->name, peer->internal_id, &peer->endpoint.addr);
@@ -433,6 +461,7 @@ static void wg_packet_consume_data_done(struct wg_peer *peer,
 	goto packet_processed;
 packet_processed:
 	dev_kfree_skb(skb);
+	return true;
 }
 
 int wg_packet_rx_poll(struct napi_struct *napi, int budget)
@@ -441,6 +470,8 @@ int wg_packet_rx_poll(struct napi_struct *napi, int budget)
 	struct noise_keypair *keypair;
 	struct endpoint endpoint;
 	enum packet_state state;
+	bool authenticated = false, data_received = false;
+	struct rx_batch batch = { .n = 0 };
 	struct sk_buff *skb;
 	int work_done = 0;
 	bool free;
@@ -471,7 +502,9 @@ int wg_packet_rx_poll(struct napi_struct *napi, int budget)
 			goto next;
 
 		wg_reset_packet(skb, false);
-		wg_packet_consume_data_done(peer, skb, &endpoint);
+		if (wg_packet_consume_data_done(peer, skb, &endpoint, &batch))
+			data_received = true;
+		authenticated = true;
 		free = false;
 
 next:
@@ -484,6 +517,21 @@ int wg_packet_rx_poll(struct napi_struct *napi, int budget)
 			break;
 	}
 
+	if (batch.n)
+		wg_packet_route_batch(peer, &batch);
+
+	/* The packets of this poll were all handed to GRO back to back; the
+	 * per-peer timer and key bookkeeping only cares about the most recent
+	 * one, so do it once for the whole batch.
+	 */
+	if (authenticated) {
+		keep_key_fresh(peer);
+		wg_timers_any_authenticated_packet_received(peer);
+		wg_timers_any_authenticated_packet_traversal(peer);
+		if (data_received)
+			wg_timers_data_received(peer);
+	}
+
 	if (work_done < budget)
 		napi_complete_done(napi, work_done);
 
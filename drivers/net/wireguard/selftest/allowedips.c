@@ -10,14 +10,17 @@
  * to graphviz (the dot command) to visualize it. If you define the macro
  * DEBUG_RANDOM_TRIE to be 1, then there will be an extremely costly set of
  * randomized tests done against a trivial implementation, which may take
- * upwards of a half-hour to complete. There's no set of users who should be
- * enabling these, and the only developers that should go anywhere near these
- * nobs are the ones who are reading this comment.
+ * upwards of a half-hour to complete. If you define the macro
+ * DEBUG_ALLOWEDIPS_PERF to be 1, then a large random table is built and the
+ * time taken by trie and stride table lookups is printed. There's no set of
+ * users who should be enabling these, and the only developers that should go
+ * anywhere near these nobs are the ones who are reading this comment.
  */
 
 #ifdef DEBUG
 
 #include <linux/siphash.h>
+#include <linux/vmalloc.h>
 
 static __init void print_node(struct allowedips_node *node, u8 bits)
 {
@@ -72,7 +75,9 @@ enum {
 	NUM_PEERS = 2000,
 	NUM_RAND_ROUTES = 400,
 	NUM_MUTATED_ROUTES = 100,
-	NUM_QUERIES = NUM_RAND_ROUTES * NUM_MUTATED_ROUTES * 30
+	NUM_QUERIES = NUM_RAND_ROUTES * NUM_MUTATED_ROUTES * 30,
+	NUM_PERF_ROUTES = 100000,
+	NUM_PERF_QUERIES = 1U << 20
 };
 
 struct horrible_allowedips {
@@ -372,6 +377,11 @@ static __init bool randomized_test(void)
 		}
 	}
 
+	if (wg_allowedips_compress(&t, &mutex) < 0) {
+		pr_err("allowedips random self-test compress: FAIL\n");
+		goto free_locked;
+	}
+
 	mutex_unlock(&mutex);
 
 	if (IS_ENABLED(DEBUG_PRINT_TRIE_GRAPHVIZ)) {
@@ -382,13 +392,16 @@ static __init bool randomized_test(void)
 	for (j = 0;; ++j) {
 		for (i = 0; i < NUM_QUERIES; ++i) {
 			prandom_bytes(ip, 4);
-			if (lookup(t.root4, 32, ip) != horrible_allowedips_lookup_v4(&h, (struct in_addr *)ip)) {
-				horrible_allowedips_lookup_v4(&h, (struct in_addr *)ip);
+			peer = horrible_allowedips_lookup_v4(&h, (struct in_addr *)ip);
+			if (lookup(t.root4, NULL, 32, ip) != peer ||
+			    lookup(t.root4, t.stride4, 32, ip) != peer) {
 				pr_err("allowedips random v4 self-test: FAIL\n");
 				goto free;
 			}
 			prandom_bytes(ip, 16);
-			if (lookup(t.root6, 128, ip) != horrible_allowedips_lookup_v6(&h, (struct in6_addr *)ip)) {
+			peer = horrible_allowedips_lookup_v6(&h, (struct in6_addr *)ip);
+			if (lookup(t.root6, NULL, 128, ip) != peer ||
+			    lookup(t.root6, t.stride6, 128, ip) != peer) {
 				pr_err("allowedips random v6 self-test: FAIL\n");
 				goto free;
 			}
@@ -397,6 +410,7 @@ static __init bool randomized_test(void)
 			break;
 		mutex_lock(&mutex);
 		wg_allowedips_remove_by_peer(&t, peers[j], &mutex);
+		wg_allowedips_compress(&t, &mutex);
 		mutex_unlock(&mutex);
 		horrible_allowedips_remove_by_value(&h, peers[j]);
 	}
@@ -422,6 +436,97 @@ static __init bool randomized_test(void)
 	return ret;
 }
 
+static __init u64 perf_lookups(struct allowedips_node __rcu *root,
+				struct allowedips_stride_table __rcu *stride,
+				u8 bits, const u8 *ips)
+{
+	u64 start = ktime_get_ns();
+	struct wg_peer *peer;
+	unsigned int i;
+
+	for (i = 0; i < NUM_PERF_QUERIES; ++i) {
+		rcu_read_lock_bh();
+		peer = __lookup(root, stride, bits, &ips[i * 16]);
+		rcu_read_unlock_bh();
+		if (peer)
+			refcount_dec(&peer->refcount.refcount);
+		cond_resched();
+	}
+	return ktime_get_ns() - start;
+}
+
+static __init bool perf_test(void)
+{
+	struct wg_peer **peers = NULL;
+	unsigned int i, cidr;
+	struct allowedips t;
+	DEFINE_MUTEX(mutex);
+	bool ret = false;
+	u8 ip[16], *ips;
+
+	mutex_init(&mutex);
+	wg_allowedips_init(&t);
+
+	ips = vmalloc(NUM_PERF_QUERIES * 16);
+	peers = kcalloc(NUM_PEERS, sizeof(*peers), GFP_KERNEL);
+	if (unlikely(!ips || !peers)) {
+		pr_err("allowedips perf test malloc: FAIL\n");
+		goto free;
+	}
+	for (i = 0; i < NUM_PEERS; ++i) {
+		peers[i] = kzalloc(sizeof(*peers[i]), GFP_KERNEL);
+		if (unlikely(!peers[i])) {
+			pr_err("allowedips perf test malloc: FAIL\n");
+			goto free;
+		}
+		/* Never released: perf_lookups() drops its references by hand. */
+		kref_init(&peers[i]->refcount);
+		INIT_LIST_HEAD(&peers[i]->allowedips_list);
+	}
+
+	mutex_lock(&mutex);
+	for (i = 0; i < NUM_PERF_ROUTES; ++i) {
+		prandom_bytes(ip, 16);
+		cidr = 8 + prandom_u32_max(25);
+		if (wg_allowedips_insert_v4(&t, (struct in_addr *)ip, cidr,
+				peers[prandom_u32_max(NUM_PEERS)], &mutex) < 0)
+			goto free_locked;
+		cidr = 16 + prandom_u32_max(113);
+		if (wg_allowedips_insert_v6(&t, (struct in6_addr *)ip, cidr,
+				peers[prandom_u32_max(NUM_PEERS)], &mutex) < 0)
+			goto free_locked;
+	}
+	if (wg_allowedips_compress(&t, &mutex) < 0) {
+		pr_err("allowedips perf test compress: FAIL\n");
+		goto free_locked;
+	}
+	mutex_unlock(&mutex);
+
+	prandom_bytes(ips, NUM_PERF_QUERIES * 16);
+	pr_info("allowedips perf v4: trie %llu ns, stride %llu ns per %u lookups\n",
+		perf_lookups(t.root4, NULL, 32, ips),
+		perf_lookups(t.root4, t.stride4, 32, ips),
+		NUM_PERF_QUERIES);
+	pr_info("allowedips perf v6: trie %llu ns, stride %llu ns per %u lookups\n",
+		perf_lookups(t.root6, NULL, 128, ips),
+		perf_lookups(t.root6, t.stride6, 128, ips),
+		NUM_PERF_QUERIES);
+	ret = true;
+
+free:
+	mutex_lock(&mutex);
+free_locked:
+	wg_allowedips_free(&t, &mutex);
+	mutex_unlock(&mutex);
+	if (peers) {
+		for (i = 0; i < NUM_PEERS; ++i)
+			kfree(peers[i]);
+	}
+	kfree(peers);
+	vfree(ips);
+	return ret;
+}
+
 static __init inline struct in_addr *ip4(u8 a, u8 b, u8 c, u8 d)
 {
 	static struct in_addr ip;
@@ -457,6 +562,55 @@ static __init struct wg_peer *init_peer(void)
 	return peer;
 }
 
+static __init struct sk_buff *init_skb(int family, const void *src)
+{
+	struct sk_buff *skb = alloc_skb(sizeof(struct ipv6hdr), GFP_KERNEL);
+
+	if (!skb)
+		return NULL;
+	skb_reset_network_header(skb);
+	if (family == AF_INET) {
+		skb_put_zero(skb, sizeof(struct iphdr));
+		skb->protocol = htons(ETH_P_IP);
+		memcpy(&ip_hdr(skb)->saddr, src, sizeof(struct in_addr));
+	} else {
+		skb_put_zero(skb, sizeof(struct ipv6hdr));
+		skb->protocol = htons(ETH_P_IPV6);
+		memcpy(&ipv6_hdr(skb)->saddr, src, sizeof(struct in6_addr));
+	}
+	return skb;
+}
+
+/* Checks that a batch of packets gets the peers of their source addresses. */
+static __init bool batch_test(struct allowedips *t, struct wg_peer *b,
+			      struct wg_peer *d)
+{
+	struct wg_peer *expected[] = { b, d, d, NULL };
+	struct sk_buff *skbs[ARRAY_SIZE(expected)] = { };
+	struct wg_peer *peers[ARRAY_SIZE(expected)];
+	bool ret = false;
+	unsigned int i;
+
+	skbs[0] = init_skb(AF_INET, ip4(192, 168, 4, 4));
+	skbs[1] = init_skb(AF_INET6, ip6(0x26075300, 0x60006b00, 0, 0xc05f0543));
+	skbs[2] = init_skb(AF_INET, ip4(10, 1, 0, 20));
+	skbs[3] = init_skb(AF_INET, ip4(10, 1, 0, 20));
+	for (i = 0; i < ARRAY_SIZE(skbs); ++i) {
+		if (!skbs[i])
+			goto out;
+	}
+	/* neither ipv4 nor ipv6 */
+	skbs[3]->protocol = htons(ETH_P_ARP);
+
+	wg_allowedips_lookup_src_batch(t, skbs, peers, ARRAY_SIZE(skbs));
+	ret = !memcmp(peers, expected, sizeof(peers));
+
+out:
+	for (i = 0; i < ARRAY_SIZE(skbs); ++i)
+		kfree_skb(skbs[i]);
+	return ret;
+}
+
 #define insert(version, mem, ipa, ipb, ipc, ipd, cidr)                       \
 	wg_allowedips_insert_v##version(&t, ip##version(ipa, ipb, ipc, ipd), \
 					cidr, mem, &mutex)
@@ -469,14 +623,23 @@ static __init struct wg_peer *init_peer(void)
 		}                                                       \
 	} while (0)
 
+/* Checks the trie on its own and through the stride table, if built. */
 #define test(version, mem, ipa, ipb, ipc, ipd) do {                          \
-		bool _s = lookup(t.root##version, (version) == 4 ? 32 : 128, \
+		bool _s = lookup(t.root##version, NULL,                      \
+				 (version) == 4 ? 32 : 128,                  \
+				 ip##version(ipa, ipb, ipc, ipd)) == (mem) &&\
+			  lookup(t.root##version, t.stride##version,         \
+				 (version) == 4 ? 32 : 128,                  \
 				 ip##version(ipa, ipb, ipc, ipd)) == (mem);  \
 		maybe_fail();                                                \
 	} while (0)
 
 #define test_negative(version, mem, ipa, ipb, ipc, ipd) do {                 \
-		bool _s = lookup(t.root##version, (version) == 4 ? 32 : 128, \
+		bool _s = lookup(t.root##version, NULL,                      \
+				 (version) == 4 ? 32 : 128,                  \
+				 ip##version(ipa, ipb, ipc, ipd)) != (mem) &&\
+			  lookup(t.root##version, t.stride##version,         \
+				 (version) == 4 ? 32 : 128,                  \
 				 ip##version(ipa, ipb, ipc, ipd)) != (mem);  \
 		maybe_fail();                                                \
 	} while (0)
@@ -545,6 +708,7 @@ bool __init wg_allowedips_selftest(void)
 
 	success = true;
 
+	test_boolean(!wg_allowedips_compress(&t, &mutex));
 	test(4, a, 192, 168, 4, 20);
 	test(4, a, 192, 168, 4, 0);
 	test(4, b, 192, 168, 4, 4);
@@ -573,6 +737,7 @@ bool __init wg_allowedips_selftest(void)
 	test(4, b, 10, 1, 0, 6);
 	test(4, c, 10, 1, 0, 10);
 	test(4, d, 10, 1, 0, 20);
+	test_boolean(batch_test(&t, b, d));
 
 	insert(4, a, 1, 0, 0, 0, 32);
 	insert(4, a, 64, 0, 0, 0, 32);
@@ -580,6 +745,7 @@ bool __init wg_allowedips_selftest(void)
 	insert(4, a, 192, 0, 0, 0, 32);
 	insert(4, a, 255, 0, 0, 0, 32);
 	wg_allowedips_remove_by_peer(&t, a, &mutex);
+	test_boolean(!wg_allowedips_compress(&t, &mutex));
 	test_negative(4, a, 1, 0, 0, 0);
 	test_negative(4, a, 64, 0, 0, 0);
 	test_negative(4, a, 128, 0, 0, 0);
@@ -649,6 +815,9 @@ bool __init wg_allowedips_selftest(void)
 	if (IS_ENABLED(DEBUG_RANDOM_TRIE) && success)
 		success = randomized_test();
 
+	if (IS_ENABLED(DEBUG_ALLOWEDIPS_PERF) && success)
+		success = perf_test();
+
 	if (success)
 		pr_info("allowedips self-tests: pass\n");
 
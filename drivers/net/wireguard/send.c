@@ -381,10 +381,30 @@ void wg_packet_send_staged_packets(struct wg_peer *peer)
 			goto out_invalid;
 	}
 
-	packets.prev->next = NULL;
-	wg_peer_get(keypair->entry.peer);
-	PACKET_CB(packets.next)->keypair = keypair;
-	wg_packet_create_data(peer, packets.next);
+	/* Hand the packets to the encryption workers in bundles of at most
+	 * MAX_BUNDLE_PACKETS, so that a large burst, such as the segments of a
+	 * GSO super-packet, is encrypted on several CPUs at once rather than
+	 * serially on one. The peer's tx_queue keeps the bundles in order.
+	 */
+	do {
+		struct sk_buff *first, *last;
+		unsigned int i;
+
+		first = last = __skb_dequeue(&packets);
+		for (i = 1; i < MAX_BUNDLE_PACKETS && !skb_queue_empty(&packets); ++i)
+			last = last->next = __skb_dequeue(&packets);
+		last->next = NULL;
+
+		/* Every bundle holds its own keypair reference. We already
+		 * hold one, so the refcount can't be zero and there is no
+		 * need for wg_noise_keypair_get() and the RCU BH read lock.
+		 */
+		if (!skb_queue_empty(&packets))
+			kref_get(&keypair->refcount);
+		wg_peer_get(keypair->entry.peer);
+		PACKET_CB(first)->keypair = keypair;
+		wg_packet_create_data(peer, first);
+	} while (!skb_queue_empty(&packets));
 	return;
 
 out_invalid:
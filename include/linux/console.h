@@ -15,6 +15,7 @@
 #define _LINUX_CONSOLE_H_ 1
 
 #include <linux/atomic.h>
+#include <linux/mutex.h>
 #include <linux/types.h>
 
 struct vc_data;
@@ -153,6 +154,14 @@ struct console {
 	uint	ospeed;
 	u64	seq;
 	unsigned long dropped;
+	struct task_struct *thread;
+	bool	blocked;
+	/*
+	 * Held by the printing kthread of the console while it prints a
+	 * record, and by console_lock() to set @blocked, which keeps the
+	 * kthread from printing while the console_lock is held.
+	 */
+	struct mutex lock;
 	void	*data;
 	struct	 console *next;
 };
@@ -90,4 +90,20 @@ static inline long do_futex(u32 __user *uaddr, int op, u32 val,
 }
 #endif
 
+#ifdef CONFIG_FUTEX_PRIVATE_HASH
+void futex_mm_init(struct mm_struct *mm);
+void futex_hash_free(struct mm_struct *mm);
+void futex_hash_grow(struct mm_struct *mm, unsigned int nr_threads);
+int futex_hash_prctl(unsigned long arg2, unsigned long arg3);
+#else
+static inline void futex_mm_init(struct mm_struct *mm) { }
+static inline void futex_hash_free(struct mm_struct *mm) { }
+static inline void futex_hash_grow(struct mm_struct *mm,
+				   unsigned int nr_threads) { }
+static inline int futex_hash_prctl(unsigned long arg2, unsigned long arg3)
+{
+	return -EINVAL;
+}
+#endif
+
 #endif
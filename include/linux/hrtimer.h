@@ -195,6 +195,10 @@ enum  hrtimer_base_type {
  * @nr_retries:		Total number of hrtimer interrupt retries
  * @nr_hangs:		Total number of hrtimer interrupt hangs
  * @max_hang_time:	Maximum time spent in hrtimer_interrupt
+ * @nr_reprograms:	Total number of clock event device reprogram operations
+ * @nr_coalesced:	Number of timer starts which expire together with the
+ *			already programmed event and did not reprogram
+ * @nr_expired:		Total number of expired timers
  * @softirq_expiry_lock: Lock which is taken while softirq based hrtimer are
  *			 expired
  * @timer_waiters:	A hrtimer_cancel() invocation waits for the timer
@@ -226,6 +230,9 @@ struct hrtimer_cpu_base {
 	unsigned short			nr_hangs;
 	unsigned int			max_hang_time;
 #endif
+	unsigned int			nr_reprograms;
+	unsigned int			nr_coalesced;
+	unsigned int			nr_expired;
 #ifdef CONFIG_PREEMPT_RT
 	spinlock_t			softirq_expiry_lock;
 	atomic_t			timer_waiters;
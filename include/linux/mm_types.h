@@ -10,6 +10,7 @@
 #include <linux/spinlock.h>
 #include <linux/rbtree.h>
 #include <linux/rwsem.h>
+#include <linux/mutex.h>
 #include <linux/completion.h>
 #include <linux/cpumask.h>
 #include <linux/uprobes.h>
@@ -28,6 +29,7 @@
 #define INIT_PASID	0
 
 struct address_space;
+struct futex_private_hash;
 struct mem_cgroup;
 
 /*
@@ -680,12 +682,29 @@ struct mm_struct {
 		 * merging.
 		 */
 		unsigned long ksm_merging_pages;
+#endif
+#ifdef CONFIG_FUTEX_PRIVATE_HASH
+		/* Serializes setting up and resizing futex_phash */
+		struct mutex futex_hash_lock;
+		struct futex_private_hash __rcu *futex_phash;
+		/* Requested size of futex_phash, 0 for automatic sizing */
+		unsigned int futex_hash_slots;
+		/* futex_phash is being resized, see futex_hash_get() */
+		bool futex_hash_migrating;
+#endif
+#ifdef CONFIG_SCHED_MM_CID
+		/*
+		 * Serializes allocation and release of concurrency IDs in
+		 * the cid bitmap, which follows cpu_bitmap.
+		 */
+		raw_spinlock_t cid_lock;
 #endif
 	} __randomize_layout;
 
 	/*
 	 * The mm_cpumask needs to be at the end of mm_struct, because it
-	 * is dynamically sized based on nr_cpu_ids.
+	 * is dynamically sized based on nr_cpu_ids. With CONFIG_SCHED_MM_CID
+	 * it is followed by the equally sized cid bitmap.
 	 */
 	unsigned long cpu_bitmap[];
 };
@@ -707,6 +726,36 @@ static inline cpumask_t *mm_cpumask(struct mm_struct *mm)
 	return (struct cpumask *)&mm->cpu_bitmap;
 }
 
+#ifdef CONFIG_SCHED_MM_CID
+/* Accessor for struct mm_struct's cidmask. */
+static inline cpumask_t *mm_cidmask(struct mm_struct *mm)
+{
+	unsigned long cid_bitmap = (unsigned long)mm;
+
+	cid_bitmap += offsetof(struct mm_struct, cpu_bitmap);
+	/* Skip cpu_bitmap */
+	cid_bitmap += cpumask_size();
+	return (struct cpumask *)cid_bitmap;
+}
+
+static inline void mm_init_cid(struct mm_struct *mm)
+{
+	raw_spin_lock_init(&mm->cid_lock);
+	cpumask_clear(mm_cidmask(mm));
+}
+
+static inline unsigned int mm_cid_size(void)
+{
+	return cpumask_size();
+}
+#else /* CONFIG_SCHED_MM_CID */
+static inline void mm_init_cid(struct mm_struct *mm) { }
+static inline unsigned int mm_cid_size(void)
+{
+	return 0;
+}
+#endif /* CONFIG_SCHED_MM_CID */
+
 struct mmu_gather;
 extern void tlb_gather_mmu(struct mmu_gather *tlb, struct mm_struct *mm);
 extern void tlb_gather_mmu_fullmm(struct mmu_gather *tlb, struct mm_struct *mm);
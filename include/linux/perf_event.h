@@ -625,6 +625,8 @@ struct swevent_hlist {
 struct bpf_prog;
 struct perf_cgroup;
 struct perf_buffer;
+struct perf_sample_batch;
+struct perf_hist;
 
 struct pmu_event_list {
 	raw_spinlock_t		lock;
@@ -728,6 +730,8 @@ struct perf_event {
 
 	struct perf_buffer		*rb;
 	struct list_head		rb_entry;
+	struct perf_sample_batch	*sample_batch;
+	struct perf_hist		*sample_hist;
 	unsigned long			rcu_batches;
 	int				rcu_pending;
 
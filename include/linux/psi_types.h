@@ -2,7 +2,9 @@
 #ifndef _LINUX_PSI_TYPES_H
 #define _LINUX_PSI_TYPES_H
 
+#include <linux/cpumask.h>
 #include <linux/kthread.h>
+#include <linux/llist.h>
 #include <linux/seqlock.h>
 #include <linux/types.h>
 #include <linux/kref.h>
@@ -153,6 +155,9 @@ struct psi_group {
 	/* Per-cpu task state & time tracking */
 	struct psi_group_cpu __percpu *pcpu;
 
+	/* CPUs with time to collect, per aggregator */
+	cpumask_var_t active_cpus[NR_PSI_AGGREGATORS];
+
 	/* Running pressure averages */
 	u64 avg_total[NR_PSI_STATES - 1];
 	u64 avg_last_update;
@@ -165,11 +170,10 @@ struct psi_group {
 	u64 total[NR_PSI_AGGREGATORS][NR_PSI_STATES - 1];
 	unsigned long avg[NR_PSI_STATES - 1][3];
 
-	/* Monitor work control */
-	struct task_struct __rcu *poll_task;
-	struct timer_list poll_timer;
-	wait_queue_head_t poll_wait;
-	atomic_t poll_wakeup;
+	/* Monitor work control, see psi_poll_worker() */
+	struct llist_node poll_kick;
+	struct list_head poll_node;
+	atomic_t poll_scheduled;
 
 	/* Protects data used by the monitor */
 	struct mutex trigger_lock;
@@ -184,6 +188,9 @@ struct psi_group {
 	u64 polling_total[NR_PSI_STATES - 1];
 	u64 polling_next_update;
 	u64 polling_until;
+
+	/* A trigger has a ratelimited event waiting to be signalled */
+	bool poll_pending;
 };
 
 #else /* CONFIG_PSI */
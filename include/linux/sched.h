@@ -548,6 +548,21 @@ struct sched_entity {
 
 	u64				nr_migrations;
 
+	/* Wakeup preemption bias derived from latency nice, in ns: */
+	long				latency_offset;
+
+	/*
+	 * EEVDF request: @slice is the requested runtime, @deadline the
+	 * virtual deadline of the current request while the entity is
+	 * queued, and the remaining virtual request while it is not.
+	 * @min_deadline caches the earliest deadline of the entity's
+	 * subtree in the cfs_rq timeline, @vlag the lag kept over a sleep.
+	 */
+	u64				slice;
+	u64				deadline;
+	u64				min_deadline;
+	s64				vlag;
+
 #ifdef CONFIG_FAIR_GROUP_SCHED
 	int				depth;
 	struct sched_entity		*parent;
@@ -774,6 +789,7 @@ struct task_struct {
 	int				static_prio;
 	int				normal_prio;
 	unsigned int			rt_priority;
+	int				latency_prio;
 
 	struct sched_entity		se;
 	struct sched_rt_entity		rt;
@@ -1299,6 +1315,12 @@ struct task_struct {
 	 * with respect to preemption.
 	 */
 	unsigned long rseq_event_mask;
+	u32 rseq_len;
+#endif
+
+#ifdef CONFIG_SCHED_MM_CID
+	int				mm_cid;		/* Current cid in mm */
+	int				mm_cid_active;	/* Whether cid bitmap is active */
 #endif
 
 	struct tlbflush_unmap_batch	tlb_ubc;
@@ -2282,6 +2304,12 @@ unsigned long sched_cpu_util(int cpu);
 
 #ifdef CONFIG_RSEQ
 
+/*
+ * Size of the original struct rseq, which the node_id and mm_cid fields
+ * were added to. Registering it is always accepted.
+ */
+#define ORIG_RSEQ_SIZE		32
+
 /*
  * Map the event mask on the user-space ABI enum rseq_cs_flags
  * for direct mask checks.
@@ -2344,10 +2372,12 @@ static inline void rseq_fork(struct task_struct *t, unsigned long clone_flags)
 {
 	if (clone_flags & CLONE_VM) {
 		t->rseq = NULL;
+		t->rseq_len = 0;
 		t->rseq_sig = 0;
 		t->rseq_event_mask = 0;
 	} else {
 		t->rseq = current->rseq;
+		t->rseq_len = current->rseq_len;
 		t->rseq_sig = current->rseq_sig;
 		t->rseq_event_mask = current->rseq_event_mask;
 	}
@@ -2356,6 +2386,7 @@ static inline void rseq_fork(struct task_struct *t, unsigned long clone_flags)
 static inline void rseq_execve(struct task_struct *t)
 {
 	t->rseq = NULL;
+	t->rseq_len = 0;
 	t->rseq_sig = 0;
 	t->rseq_event_mask = 0;
 }
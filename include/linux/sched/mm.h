@@ -127,6 +127,31 @@ extern void exit_mm_release(struct task_struct *, struct mm_struct *);
 /* Remove the current tasks stale references to the old mm_struct on exec() */
 extern void exec_mm_release(struct task_struct *, struct mm_struct *);
 
+#ifdef CONFIG_SCHED_MM_CID
+void sched_mm_cid_activate(struct task_struct *t);
+void sched_mm_cid_deactivate(struct task_struct *t);
+void sched_mm_cid_fork(struct task_struct *t);
+
+static inline int task_mm_cid(struct task_struct *t)
+{
+	return t->mm_cid;
+}
+#else
+static inline void sched_mm_cid_activate(struct task_struct *t) { }
+static inline void sched_mm_cid_deactivate(struct task_struct *t) { }
+static inline void sched_mm_cid_fork(struct task_struct *t) { }
+
+static inline int task_mm_cid(struct task_struct *t)
+{
+	/*
+	 * Use the processor id as a fall-back when the mm cid feature is
+	 * disabled. This provides functional per-cpu data structure accesses
+	 * in user-space, although it won't provide the memory usage benefits.
+	 */
+	return raw_smp_processor_id();
+}
+#endif
+
 #ifdef CONFIG_MEMCG
 extern void mm_update_next_owner(struct mm_struct *mm);
 #else
@@ -82,8 +82,24 @@ struct sched_domain_shared {
 	atomic_t	nr_busy_cpus;
 	int		has_idle_cores;
 	int		nr_idle_scan;
+
+	/*
+	 * Two cpumasks, see sds_idle_cpus() and sds_idle_cores(); hints only,
+	 * set and cleared by each CPU as it enters and leaves idle.
+	 */
+	unsigned long	idle_masks[];
 };
 
+static inline struct cpumask *sds_idle_cpus(struct sched_domain_shared *sds)
+{
+	return to_cpumask(sds->idle_masks);
+}
+
+static inline struct cpumask *sds_idle_cores(struct sched_domain_shared *sds)
+{
+	return to_cpumask(sds->idle_masks + BITS_TO_LONGS(nr_cpumask_bits));
+}
+
 struct sched_domain {
 	/* These fields must be setup */
 	struct sched_domain __rcu *parent;	/* top domain must be null terminated */
@@ -141,6 +157,15 @@ struct sched_domain {
 	unsigned int ttwu_wake_remote;
 	unsigned int ttwu_move_affine;
 	unsigned int ttwu_move_balance;
+
+	/* select_idle_cpu() idle mask stats */
+	unsigned int sis_mask_hit;
+	unsigned int sis_mask_miss;
+
+	/* newidle_balance() budgeting stats */
+	unsigned int nib_skipped;
+	unsigned int nib_expensive;
+	u64 nib_cost;
 #endif
 #ifdef CONFIG_SCHED_DEBUG
 	char *name;
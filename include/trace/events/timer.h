@@ -417,6 +417,35 @@ TRACE_EVENT(tick_stop,
 	TP_printk("success=%d dependency=%s",  __entry->success, \
 			show_tick_dep_name(__entry->dependency))
 );
+
+/**
+ * tick_nohz_full_interrupt - called when a nohz_full CPU is interrupted
+ * @cpu:	the interrupted CPU
+ * @kick:	true for a kick to re-evaluate the tick dependencies, false
+ *		for a tick taken while a task was running
+ * @count:	number of such interruptions of @cpu so far
+ */
+TRACE_EVENT(tick_nohz_full_interrupt,
+
+	TP_PROTO(int cpu, bool kick, unsigned long count),
+
+	TP_ARGS(cpu, kick, count),
+
+	TP_STRUCT__entry(
+		__field( int,		cpu	)
+		__field( bool,		kick	)
+		__field( unsigned long,	count	)
+	),
+
+	TP_fast_assign(
+		__entry->cpu	= cpu;
+		__entry->kick	= kick;
+		__entry->count	= count;
+	),
+
+	TP_printk("cpu=%d cause=%s count=%lu", __entry->cpu,
+		  __entry->kick ? "kick" : "tick", __entry->count)
+);
 #endif
 
 #endif /*  _TRACE_TIMER_H */
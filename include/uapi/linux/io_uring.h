@@ -279,10 +279,18 @@ enum io_uring_op {
  *
  * IORING_RECVSEND_FIXED_BUF	Use registered buffers, the index is stored in
  *				the buf_index field.
+ *
+ * IORING_RECVSEND_BUNDLE	Used with IOSQE_BUFFER_SELECT and a ring mapped
+ *				provided buffer group. A single recv may fill
+ *				several consecutive buffers from the ring, and
+ *				the CQE reports the first buffer ID along with
+ *				the total number of bytes received across all
+ *				of them.
  */
 #define IORING_RECVSEND_POLL_FIRST	(1U << 0)
 #define IORING_RECV_MULTISHOT		(1U << 1)
 #define IORING_RECVSEND_FIXED_BUF	(1U << 2)
+#define IORING_RECVSEND_BUNDLE		(1U << 3)
 
 /*
  * accept flags stored in sqe->ioprio
@@ -427,6 +435,7 @@ struct io_uring_params {
 #define IORING_FEAT_RSRC_TAGS		(1U << 10)
 #define IORING_FEAT_CQE_SKIP		(1U << 11)
 #define IORING_FEAT_LINKED_FILE		(1U << 12)
+#define IORING_FEAT_RECVSEND_BUNDLE	(1U << 13)
 
 /*
  * io_uring_register(2) opcodes and arguments
@@ -473,6 +482,10 @@ enum {
 	/* register a range of fixed file slots for automatic slot allocation */
 	IORING_REGISTER_FILE_ALLOC_RANGE	= 25,
 
+	/* enable/disable io-wq work stealing between NUMA nodes */
+	IORING_REGISTER_IOWQ_STEAL		= 26,
+	IORING_UNREGISTER_IOWQ_STEAL		= 27,
+
 	/* this goes last */
 	IORING_REGISTER_LAST
 };
@@ -122,7 +122,12 @@
  *                          parameter is 0; if @flags parameter is
  *                          MEMBARRIER_CMD_FLAG_CPU,
  *                          then this operation is performed only
- *                          on CPU indicated by @cpu_id. If this command is
+ *                          on CPU indicated by @cpu_id; if @flags
+ *                          parameter is MEMBARRIER_CMD_FLAG_CPU_MASK,
+ *                          then this operation is performed only on
+ *                          the CPUs selected by the mask in the upper
+ *                          bits of @flags, relative to @cpu_id (see
+ *                          enum membarrier_cmd_flag). If this command is
  *                          not implemented by an architecture, -EINVAL
  *                          is returned. A process needs to register its
  *                          intent to use the private expedited rseq
@@ -158,8 +163,24 @@ enum membarrier_cmd {
 	MEMBARRIER_CMD_SHARED			= MEMBARRIER_CMD_GLOBAL,
 };
 
+/**
+ * enum membarrier_cmd_flag - membarrier system call command flags
+ * @MEMBARRIER_CMD_FLAG_CPU:      Target only the CPU given in @cpu_id.
+ * @MEMBARRIER_CMD_FLAG_CPU_MASK: Target only the CPUs @cpu_id + n for each
+ *                                bit n set in
+ *                                (@flags >> MEMBARRIER_CMD_FLAG_CPU_MASK_SHIFT).
+ *                                Up to MEMBARRIER_CMD_FLAG_CPU_MASK_BITS
+ *                                CPUs can be selected per call, @cpu_id must
+ *                                not be negative and at least one bit must be
+ *                                set. Cannot be combined with
+ *                                MEMBARRIER_CMD_FLAG_CPU.
+ */
 enum membarrier_cmd_flag {
 	MEMBARRIER_CMD_FLAG_CPU		= (1 << 0),
+	MEMBARRIER_CMD_FLAG_CPU_MASK	= (1 << 1),
 };
 
+#define MEMBARRIER_CMD_FLAG_CPU_MASK_SHIFT	8
+#define MEMBARRIER_CMD_FLAG_CPU_MASK_BITS	24
+
 #endif /* _UAPI_LINUX_MEMBARRIER_H */
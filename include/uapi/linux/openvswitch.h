@@ -76,6 +76,9 @@ enum ovs_datapath_cmd {
  * datapath.  Always present in notifications.
  * @OVS_DP_ATTR_MEGAFLOW_STATS: Statistics about mega flow masks usage for the
  * datapath. Always present in notifications.
+ * @OVS_DP_ATTR_MICROFLOW_CACHE_SIZE: Number of per-cpu entries remembering
+ * the flow the last packet with a given skb hash matched. Zero, the default,
+ * disables the microflow cache; otherwise it must be a power of two.
  *
  * These attributes follow the &struct ovs_header within the Generic Netlink
  * payload for %OVS_DP_* commands.
@@ -92,6 +95,7 @@ enum ovs_datapath_attr {
 	OVS_DP_ATTR_PER_CPU_PIDS,   /* Netlink PIDS to receive upcalls in
 				     * per-cpu dispatch mode
 				     */
+	OVS_DP_ATTR_MICROFLOW_CACHE_SIZE,
 	__OVS_DP_ATTR_MAX
 };
 
@@ -109,7 +113,7 @@ struct ovs_dp_megaflow_stats {
 	__u32 n_masks;		 /* Number of masks for the datapath. */
 	__u32 pad0;		 /* Pad for future expension. */
 	__u64 n_cache_hit;       /* Number of cache matches for flow lookups. */
-	__u64 pad1;		 /* Pad for future expension. */
+	__u64 n_microflow_hit;	 /* Number of microflow cache matches. */
 };
 
 struct ovs_vport_stats {
@@ -414,7 +414,9 @@ struct perf_event_attr {
 				inherit_thread :  1, /* children only inherit if cloned with CLONE_THREAD */
 				remove_on_exec :  1, /* event is removed from task on exec */
 				sigtrap        :  1, /* send synchronous SIGTRAP on event */
-				__reserved_1   : 26;
+				sample_batch   :  1, /* commit samples to the ring buffer in batches */
+				sample_hist    :  1, /* aggregate samples into PERF_RECORD_HIST */
+				__reserved_1   : 24;
 
 	union {
 		__u32		wakeup_events;	  /* wakeup every n events */
@@ -465,7 +467,11 @@ struct perf_event_attr {
 	__u16	sample_max_stack;
 	__u16	__reserved_2;
 	__u32	aux_sample_size;
-	__u32	__reserved_3;
+	/*
+	 * Number of entries of the sample_hist histogram, a power of two
+	 * up to 4096; 0 picks the default.
+	 */
+	__u32	sample_hist_entries;
 
 	/*
 	 * User provided data if sigtrap=1, passed back to user via
@@ -512,6 +518,7 @@ struct perf_event_query_bpf {
 #define PERF_EVENT_IOC_PAUSE_OUTPUT		_IOW('$', 9, __u32)
 #define PERF_EVENT_IOC_QUERY_BPF		_IOWR('$', 10, struct perf_event_query_bpf *)
 #define PERF_EVENT_IOC_MODIFY_ATTRIBUTES	_IOW('$', 11, struct perf_event_attr *)
+#define PERF_EVENT_IOC_FLUSH_HIST		_IO ('$', 12)
 
 enum perf_event_ioc_flags {
 	PERF_IOC_FLAG_GROUP		= 1U << 0,
@@ -1163,6 +1170,27 @@ enum perf_event_type {
 	 */
 	PERF_RECORD_AUX_OUTPUT_HW_ID		= 21,
 
+	/*
+	 * Samples of an event with attr.sample_hist, aggregated by pid and
+	 * stack. @ips is the callchain with PERF_SAMPLE_CALLCHAIN, truncated
+	 * to 32 entries, and the sampled IP otherwise. Records are emitted
+	 * when the in-kernel histogram runs out of room and all at once on
+	 * PERF_EVENT_IOC_FLUSH_HIST, disable and close; a pid and stack can
+	 * be reported in several records whose counts add up. Inherited
+	 * events, which must be per CPU, count into the histogram of their
+	 * parent.
+	 *
+	 * struct {
+	 *	struct perf_event_header	header;
+	 *	u64				count;
+	 *	u32				pid;
+	 *	u32				nr;
+	 *	u64				ips[nr];
+	 *	struct sample_id		sample_id;
+	 * };
+	 */
+	PERF_RECORD_HIST			= 22,
+
 	PERF_RECORD_MAX,			/* non-ABI */
 };
 
@@ -284,4 +284,9 @@ struct prctl_mm_map {
 #define PR_SET_VMA		0x53564d41
 # define PR_SET_VMA_ANON_NAME		0
 
+/* Per process private futex hash */
+#define PR_FUTEX_HASH			65
+# define PR_FUTEX_HASH_SET_SLOTS	1	/* 0: grow with the threads */
+# define PR_FUTEX_HASH_GET_SLOTS	2
+
 #endif /* _LINUX_PRCTL_H */
@@ -58,6 +58,15 @@ struct rseq_cs {
  * contained within a single cache-line.
  *
  * A single struct rseq per thread is allowed.
+ *
+ * The fields following flags were added to the padding of the original
+ * 32-byte structure, so sizeof(struct rseq) is still 32. The kernel
+ * advertises the size of the fields it updates, offsetof(struct rseq,
+ * end), in the ELF auxiliary vector as AT_RSEQ_FEATURE_SIZE, and the
+ * required alignment as AT_RSEQ_ALIGN. Without AT_RSEQ_FEATURE_SIZE only
+ * the fields up to and including flags are updated. The rseq_len passed
+ * at registration is at least 32, and at least the feature size, and at
+ * most the page size.
  */
 struct rseq {
 	/*
@@ -130,6 +139,34 @@ struct rseq {
 	 *     this thread.
 	 */
 	__u32 flags;
+
+	/*
+	 * Restartable sequences node_id field. Updated by the kernel. Read
+	 * by user-space with single-copy atomicity semantics. This field
+	 * should only be read by the thread which registered this data
+	 * structure. Aligned on 32-bit. Contains the current NUMA node ID.
+	 */
+	__u32 node_id;
+
+	/*
+	 * Restartable sequences mm_cid field. Updated by the kernel. Read
+	 * by user-space with single-copy atomicity semantics. This field
+	 * should only be read by the thread which registered this data
+	 * structure. Aligned on 32-bit.
+	 *
+	 * Contains the current thread's concurrency ID, allocated densely
+	 * among the threads of the memory map which registered rseq. It is
+	 * smaller than both the number of such threads and the number of
+	 * CPUs they are allowed to run on, which makes it suitable to index
+	 * compact per-CPU-like data. It must be compared like the cpu_id
+	 * field within rseq critical sections.
+	 */
+	__u32 mm_cid;
+
+	/*
+	 * Flexible array member at end of structure, after last feature field.
+	 */
+	char end[];
 } __attribute__((aligned(4 * sizeof(__u64))));
 
 #endif /* _UAPI_LINUX_RSEQ_H */
@@ -32,6 +32,7 @@ enum {
 
 enum {
 	IO_WQ_BIT_EXIT		= 0,	/* wq exiting */
+	IO_WQ_BIT_STEAL		= 1,	/* idle workers steal from other nodes */
 };
 
 enum {
@@ -107,6 +108,10 @@ struct io_wqe {
 	struct io_wq_work *hash_tail[IO_WQ_NR_HASH_BUCKETS];
 
 	cpumask_var_t cpu_mask;
+
+	/* other nodes, nearest first, for work stealing */
+	int nr_steal_nodes;
+	int *steal_nodes;
 };
 
 /*
@@ -463,14 +468,19 @@ static bool io_wait_on_hash(struct io_wqe *wqe, unsigned int hash)
 	return ret;
 }
 
-static struct io_wq_work *io_get_next_work(struct io_wqe_acct *acct,
-					   struct io_worker *worker)
+/*
+ * Take the first runnable item off @acct. Hashed work is only runnable if no
+ * other worker, on any node, is currently running work with the same hash.
+ * If we skipped over hashed work, the first such hash is returned in
+ * @stall_hash.
+ */
+static struct io_wq_work *io_acct_take_work(struct io_wqe_acct *acct,
+					    struct io_wqe *wqe,
+					    unsigned int *stall_hash)
 	__must_hold(acct->lock)
 {
 	struct io_wq_work_node *node, *prev;
 	struct io_wq_work *work, *tail;
-	unsigned int stall_hash = -1U;
-	struct io_wqe *wqe = worker->wqe;
 
 	wq_list_for_each(node, prev, &acct->work_list) {
 		unsigned int hash;
@@ -493,12 +503,27 @@ static struct io_wq_work *io_get_next_work(struct io_wqe_acct *acct,
 			wq_list_cut(&acct->work_list, &tail->list, prev);
 			return work;
 		}
-		if (stall_hash == -1U)
-			stall_hash = hash;
+		if (*stall_hash == -1U)
+			*stall_hash = hash;
 		/* fast forward to a next hash, for-each will fix up @prev */
 		node = &tail->list;
 	}
 
+	return NULL;
+}
+
+static struct io_wq_work *io_get_next_work(struct io_wqe_acct *acct,
+					   struct io_worker *worker)
+	__must_hold(acct->lock)
+{
+	struct io_wqe *wqe = worker->wqe;
+	unsigned int stall_hash = -1U;
+	struct io_wq_work *work;
+
+	work = io_acct_take_work(acct, wqe, &stall_hash);
+	if (work)
+		return work;
+
 	if (stall_hash != -1U) {
 		bool unstalled;
 
@@ -536,13 +561,71 @@ static void io_assign_current_work(struct io_worker *worker,
 
 static void io_wqe_enqueue(struct io_wqe *wqe, struct io_wq_work *work);
 
-static void io_worker_handle_work(struct io_worker *worker)
+/*
+ * Run @work and everything that depends on it. @acct is the list the work
+ * was taken from, which differs from the worker's own for stolen work.
+ */
+static void io_worker_run_work(struct io_worker *worker,
+			       struct io_wq_work *work,
+			       struct io_wqe_acct *acct)
 {
-	struct io_wqe_acct *acct = io_wqe_get_acct(worker);
 	struct io_wqe *wqe = worker->wqe;
 	struct io_wq *wq = wqe->wq;
 	bool do_kill = test_bit(IO_WQ_BIT_EXIT, &wq->state);
 
+	__io_worker_busy(wqe, worker);
+
+	/*
+	 * Make sure cancelation can find this, even before it becomes the
+	 * active work. That avoids a window where the work has been removed
+	 * from our general work list, but isn't yet discoverable as the
+	 * current work item for this worker.
+	 */
+	raw_spin_lock(&worker->lock);
+	worker->next_work = work;
+	raw_spin_unlock(&worker->lock);
+
+	io_assign_current_work(worker, work);
+	__set_current_state(TASK_RUNNING);
+
+	/* handle a whole dependent link */
+	do {
+		struct io_wq_work *next_hashed, *linked;
+		unsigned int hash = io_get_work_hash(work);
+
+		next_hashed = wq_next_work(work);
+
+		if (unlikely(do_kill) && (work->flags & IO_WQ_WORK_UNBOUND))
+			work->flags |= IO_WQ_WORK_CANCEL;
+		wq->do_work(work);
+		io_assign_current_work(worker, NULL);
+
+		linked = wq->free_work(work);
+		work = next_hashed;
+		if (!work && linked && !io_wq_is_hashed(linked)) {
+			work = linked;
+			linked = NULL;
+		}
+		io_assign_current_work(worker, work);
+		if (linked)
+			io_wqe_enqueue(wqe, linked);
+
+		if (hash != -1U && !next_hashed) {
+			/* serialize hash clear with wake_up() */
+			spin_lock_irq(&wq->hash->wait.lock);
+			clear_bit(hash, &wq->hash->map);
+			clear_bit(IO_ACCT_STALLED_BIT, &acct->flags);
+			spin_unlock_irq(&wq->hash->wait.lock);
+			if (wq_has_sleeper(&wq->hash->wait))
+				wake_up(&wq->hash->wait);
+		}
+	} while (work);
+}
+
+static void io_worker_handle_work(struct io_worker *worker)
+{
+	struct io_wqe_acct *acct = io_wqe_get_acct(worker);
+
 	do {
 		struct io_wq_work *work;
 
@@ -556,60 +639,70 @@ static void io_worker_handle_work(struct io_worker *worker)
 		raw_spin_lock(&acct->lock);
 		work = io_get_next_work(acct, worker);
 		raw_spin_unlock(&acct->lock);
-		if (work) {
-			__io_worker_busy(wqe, worker);
-
-			/*
-			 * Make sure cancelation can find this, even before
-			 * it becomes the active work. That avoids a window
-			 * where the work has been removed from our general
-			 * work list, but isn't yet discoverable as the
-			 * current work item for this worker.
-			 */
-			raw_spin_lock(&worker->lock);
-			worker->next_work = work;
-			raw_spin_unlock(&worker->lock);
-		} else {
+		if (!work)
 			break;
-		}
-		io_assign_current_work(worker, work);
-		__set_current_state(TASK_RUNNING);
-
-		/* handle a whole dependent link */
-		do {
-			struct io_wq_work *next_hashed, *linked;
-			unsigned int hash = io_get_work_hash(work);
-
-			next_hashed = wq_next_work(work);
-
-			if (unlikely(do_kill) && (work->flags & IO_WQ_WORK_UNBOUND))
-				work->flags |= IO_WQ_WORK_CANCEL;
-			wq->do_work(work);
-			io_assign_current_work(worker, NULL);
-
-			linked = wq->free_work(work);
-			work = next_hashed;
-			if (!work && linked && !io_wq_is_hashed(linked)) {
-				work = linked;
-				linked = NULL;
-			}
-			io_assign_current_work(worker, work);
-			if (linked)
-				io_wqe_enqueue(wqe, linked);
-
-			if (hash != -1U && !next_hashed) {
-				/* serialize hash clear with wake_up() */
-				spin_lock_irq(&wq->hash->wait.lock);
-				clear_bit(hash, &wq->hash->map);
-				clear_bit(IO_ACCT_STALLED_BIT, &acct->flags);
-				spin_unlock_irq(&wq->hash->wait.lock);
-				if (wq_has_sleeper(&wq->hash->wait))
-					wake_up(&wq->hash->wait);
-			}
-		} while (work);
+		io_worker_run_work(worker, work, acct);
 	} while (1);
 }
 
+/*
+ * Called by a worker that ran out of local work. Look at the same class of
+ * work on the other nodes, nearest first, and run the first item we can.
+ * Hashed work is taken under the owning acct lock and the shared hash map,
+ * so it stays serialized against workers on every node. We never wait on a
+ * stalled hash here, that is left to the owning node.
+ */
+static bool io_worker_steal_work(struct io_worker *worker)
+{
+	struct io_wqe *wqe = worker->wqe;
+	struct io_wq *wq = wqe->wq;
+	int index = io_wqe_get_acct(worker)->index;
+	int i;
+
+	if (!test_bit(IO_WQ_BIT_STEAL, &wq->state) ||
+	    test_bit(IO_WQ_BIT_EXIT, &wq->state))
+		return false;
+
+	for (i = 0; i < wqe->nr_steal_nodes; i++) {
+		struct io_wqe *victim = wq->wqes[wqe->steal_nodes[i]];
+		struct io_wqe_acct *acct = &victim->acct[index];
+		unsigned int stall_hash = -1U;
+		struct io_wq_work *work;
+
+		if (wq_list_empty(&acct->work_list))
+			continue;
+
+		raw_spin_lock(&acct->lock);
+		work = io_acct_take_work(acct, victim, &stall_hash);
+		raw_spin_unlock(&acct->lock);
+		if (work) {
+			io_worker_run_work(worker, work, acct);
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Local work was queued, but every worker for it is busy and we can't create
+ * more. Wake an idle worker on the nearest node that has one, it'll pick the
+ * work up through io_worker_steal_work().
+ */
+static void io_wqe_kick_stealer(struct io_wqe *wqe, struct io_wqe_acct *acct)
+{
+	struct io_wq *wq = wqe->wq;
+	int i;
+
+	rcu_read_lock();
+	for (i = 0; i < wqe->nr_steal_nodes; i++) {
+		struct io_wqe *other = wq->wqes[wqe->steal_nodes[i]];
+
+		if (io_wqe_activate_free_worker(other, &other->acct[acct->index]))
+			break;
+	}
+	rcu_read_unlock();
+}
+
 static int io_wqe_worker(void *data)
 {
 	struct io_worker *worker = data;
@@ -630,6 +723,8 @@ static int io_wqe_worker(void *data)
 		set_current_state(TASK_INTERRUPTIBLE);
 		while (io_acct_run_queue(acct))
 			io_worker_handle_work(worker);
+		if (io_worker_steal_work(worker))
+			continue;
 
 		raw_spin_lock(&wqe->lock);
 		/* timed out, exit unless we're the last worker */
@@ -929,6 +1024,10 @@ static void io_wqe_enqueue(struct io_wqe *wqe, struct io_wq_work *work)
 
 	raw_spin_unlock(&wqe->lock);
 
+	if (do_create && test_bit(IO_WQ_BIT_STEAL, &wqe->wq->state) &&
+	    READ_ONCE(acct->nr_workers) >= READ_ONCE(acct->max_workers))
+		io_wqe_kick_stealer(wqe, acct);
+
 	if (do_create && ((work_flags & IO_WQ_WORK_CONCURRENT) ||
 	    !atomic_read(&acct->nr_running))) {
 		bool did_create;
@@ -1132,6 +1231,37 @@ static int io_wqe_hash_wake(struct wait_queue_entry *wait, unsigned mode,
 	return 1;
 }
 
+/*
+ * Fill in the list of nodes @wqe may steal work from, ordered by distance.
+ */
+static int io_wqe_init_steal_nodes(struct io_wqe *wqe, int node)
+{
+	int i, j, other;
+
+	wqe->steal_nodes = kmalloc_array_node(nr_node_ids, sizeof(int),
+					      GFP_KERNEL, wqe->node);
+	if (!wqe->steal_nodes)
+		return -ENOMEM;
+
+	wqe->nr_steal_nodes = 0;
+	for_each_node(other) {
+		int dist = node_distance(node, other);
+
+		if (other == node)
+			continue;
+		/* insertion sort, the list is short */
+		for (i = wqe->nr_steal_nodes; i > 0; i--) {
+			j = wqe->steal_nodes[i - 1];
+			if (node_distance(node, j) <= dist)
+				break;
+			wqe->steal_nodes[i] = j;
+		}
+		wqe->steal_nodes[i] = other;
+		wqe->nr_steal_nodes++;
+	}
+	return 0;
+}
+
 struct io_wq *io_wq_create(unsigned bounded, struct io_wq_data *data)
 {
 	int ret, node, i;
@@ -1169,6 +1299,8 @@ struct io_wq *io_wq_create(unsigned bounded, struct io_wq_data *data)
 			goto err;
 		cpumask_copy(wqe->cpu_mask, cpumask_of_node(node));
 		wqe->node = alloc_node;
+		if (io_wqe_init_steal_nodes(wqe, node))
+			goto err;
 		wqe->acct[IO_WQ_ACCT_BOUND].max_workers = bounded;
 		wqe->acct[IO_WQ_ACCT_UNBOUND].max_workers =
 					task_rlimit(current, RLIMIT_NPROC);
@@ -1199,6 +1331,7 @@ struct io_wq *io_wq_create(unsigned bounded, struct io_wq_data *data)
 		if (!wq->wqes[node])
 			continue;
 		free_cpumask_var(wq->wqes[node]->cpu_mask);
+		kfree(wq->wqes[node]->steal_nodes);
 		kfree(wq->wqes[node]);
 	}
 err_wq:
@@ -1275,6 +1408,7 @@ static void io_wq_destroy(struct io_wq *wq)
 		};
 		io_wqe_cancel_pending_work(wqe, &match);
 		free_cpumask_var(wqe->cpu_mask);
+		kfree(wqe->steal_nodes);
 		kfree(wqe);
 	}
 	io_wq_put_hash(wq->hash);
@@ -1351,6 +1485,17 @@ int io_wq_cpu_affinity(struct io_wq *wq, cpumask_var_t mask)
 	return 0;
 }
 
+/*
+ * Enable or disable stealing of queued work between the per-node pools.
+ */
+void io_wq_set_steal(struct io_wq *wq, bool enable)
+{
+	if (enable)
+		set_bit(IO_WQ_BIT_STEAL, &wq->state);
+	else
+		clear_bit(IO_WQ_BIT_STEAL, &wq->state);
+}
+
 /*
  * Set max number of unbounded workers, returns old value. If new_count is 0,
  * then just return the old value.
@@ -125,26 +125,35 @@ static void __user *io_provided_buffer_select(struct io_kiocb *req, size_t *len,
 	return NULL;
 }
 
-static void __user *io_ring_buffer_select(struct io_kiocb *req, size_t *len,
-					  struct io_buffer_list *bl,
-					  unsigned int issue_flags)
+static struct io_uring_buf *io_ring_head_to_buf(struct io_buffer_list *bl,
+						__u16 head)
 {
-	struct io_uring_buf_ring *br = bl->buf_ring;
 	struct io_uring_buf *buf;
-	__u16 head = bl->head;
-
-	if (unlikely(smp_load_acquire(&br->tail) == head))
-		return NULL;
 
 	head &= bl->mask;
 	if (head < IO_BUFFER_LIST_BUF_PER_PAGE) {
-		buf = &br->bufs[head];
+		buf = &bl->buf_ring->bufs[head];
 	} else {
 		int off = head & (IO_BUFFER_LIST_BUF_PER_PAGE - 1);
 		int index = head / IO_BUFFER_LIST_BUF_PER_PAGE;
 		buf = page_address(bl->buf_pages[index]);
 		buf += off;
 	}
+	return buf;
+}
+
+static void __user *io_ring_buffer_select(struct io_kiocb *req, size_t *len,
+					  struct io_buffer_list *bl,
+					  unsigned int issue_flags)
+{
+	struct io_uring_buf_ring *br = bl->buf_ring;
+	struct io_uring_buf *buf;
+	__u16 head = bl->head;
+
+	if (unlikely(smp_load_acquire(&br->tail) == head))
+		return NULL;
+
+	buf = io_ring_head_to_buf(bl, head);
 	if (*len == 0 || *len > buf->len)
 		*len = buf->len;
 	req->flags |= REQ_F_BUFFER_RING;
@@ -188,6 +197,98 @@ void __user *io_buffer_select(struct io_kiocb *req, size_t *len,
 	return ret;
 }
 
+/*
+ * Peek at up to @nr_iovs buffers starting at the current ring head, without
+ * consuming them. The caller commits the number of buffers actually used
+ * through io_put_kbufs() once the transfer has completed, anything left
+ * over simply stays at the head of the ring for the next request.
+ */
+static int io_ring_buffers_peek(struct io_kiocb *req, struct iovec *iovs,
+				int nr_iovs, size_t max_len,
+				struct io_buffer_list *bl)
+{
+	struct io_uring_buf_ring *br = bl->buf_ring;
+	__u16 head = bl->head;
+	int nr_avail, i;
+
+	nr_avail = (__u16) (smp_load_acquire(&br->tail) - head);
+	if (unlikely(!nr_avail))
+		return -ENOBUFS;
+	if (nr_iovs > nr_avail)
+		nr_iovs = nr_avail;
+
+	for (i = 0; i < nr_iovs; i++) {
+		struct io_uring_buf *buf = io_ring_head_to_buf(bl, head + i);
+		size_t len = READ_ONCE(buf->len);
+
+		if (unlikely(!len))
+			break;
+		if (!i)
+			req->buf_index = buf->bid;
+		if (max_len && len > max_len)
+			len = max_len;
+		iovs[i].iov_base = u64_to_user_ptr(buf->addr);
+		iovs[i].iov_len = len;
+		if (max_len) {
+			max_len -= len;
+			if (!max_len) {
+				i++;
+				break;
+			}
+		}
+	}
+	if (unlikely(!i))
+		return -ENOBUFS;
+
+	req->flags |= REQ_F_BUFFER_RING;
+	req->buf_list = bl;
+	return i;
+}
+
+/*
+ * Select one or more buffers for a bundle transfer. Multiple buffers are
+ * only handed out for ring mapped groups when we hold the uring_lock and
+ * the file is pollable, as that is the only case where the ring head can be
+ * committed after the transfer. Otherwise this falls back to selecting a
+ * single buffer, exactly like io_buffer_select().
+ *
+ * Returns the number of iovecs filled in, or -ENOBUFS.
+ */
+int io_buffers_select(struct io_kiocb *req, struct iovec *iovs, int nr_iovs,
+		      size_t max_len, unsigned int issue_flags)
+{
+	struct io_ring_ctx *ctx = req->ctx;
+	struct io_buffer_list *bl;
+	int ret = -ENOBUFS;
+
+	io_ring_submit_lock(ctx, issue_flags);
+
+	bl = io_buffer_get_list(ctx, req->buf_index);
+	if (unlikely(!bl))
+		goto out_unlock;
+
+	if (bl->buf_nr_pages && !(issue_flags & IO_URING_F_UNLOCKED) &&
+	    file_can_poll(req->file)) {
+		ret = io_ring_buffers_peek(req, iovs, nr_iovs, max_len, bl);
+	} else {
+		size_t len = max_len;
+		void __user *buf;
+
+		if (bl->buf_nr_pages)
+			buf = io_ring_buffer_select(req, &len, bl, issue_flags);
+		else
+			buf = io_provided_buffer_select(req, &len, bl);
+		if (buf) {
+			iovs[0].iov_base = buf;
+			iovs[0].iov_len = len;
+			ret = 1;
+		}
+	}
+out_unlock:
+	io_ring_submit_unlock(ctx, issue_flags);
+	return ret;
+}
+
 static __cold int io_init_bl_list(struct io_ring_ctx *ctx)
 {
 	int i;
@@ -49,6 +49,12 @@ struct io_connect {
 	bool				in_progress;
 };
 
+/*
+ * Maximum number of provided buffers a single IORING_RECVSEND_BUNDLE recv
+ * will fill before posting a completion.
+ */
+#define IO_RECV_BUNDLE_MAX	UIO_FASTIOV
+
 struct io_sr_msg {
 	struct file			*file;
 	union {
@@ -504,7 +510,8 @@ int io_recvmsg_prep_async(struct io_kiocb *req)
 	return ret;
 }
 
-#define RECVMSG_FLAGS (IORING_RECVSEND_POLL_FIRST | IORING_RECV_MULTISHOT)
+#define RECVMSG_FLAGS (IORING_RECVSEND_POLL_FIRST | IORING_RECV_MULTISHOT | \
+			IORING_RECVSEND_BUNDLE)
 
 int io_recvmsg_prep(struct io_kiocb *req, const struct io_uring_sqe *sqe)
 {
@@ -532,6 +539,14 @@ int io_recvmsg_prep(struct io_kiocb *req, const struct io_uring_sqe *sqe)
 			return -EINVAL;
 		req->flags |= REQ_F_APOLL_MULTISHOT;
 	}
+	if (sr->flags & IORING_RECVSEND_BUNDLE) {
+		if (req->opcode != IORING_OP_RECV)
+			return -EINVAL;
+		if (!(req->flags & REQ_F_BUFFER_SELECT))
+			return -EINVAL;
+		if (sr->msg_flags & MSG_WAITALL)
+			return -EINVAL;
+	}
 
 #ifdef CONFIG_COMPAT
 	if (req->ctx->compat)
@@ -782,15 +797,30 @@ int io_recvmsg(struct io_kiocb *req, unsigned int issue_flags)
 	return ret;
 }
 
+/*
+ * Number of buffers of a bundle that were touched by a transfer of @ret
+ * bytes. Buffers are filled in order, so all but the last one are full.
+ */
+static int io_bundle_nbufs(const struct iovec *iovs, int nr_iovs, int ret)
+{
+	int nbufs = 0;
+
+	while (ret > 0 && nbufs < nr_iovs) {
+		ret -= min_t(int, ret, iovs[nbufs].iov_len);
+		nbufs++;
+	}
+	return nbufs;
+}
+
 int io_recv(struct io_kiocb *req, unsigned int issue_flags)
 {
 	struct io_sr_msg *sr = io_kiocb_to_cmd(req, struct io_sr_msg);
+	struct iovec iovs[IO_RECV_BUNDLE_MAX];
 	struct msghdr msg;
 	struct socket *sock;
-	struct iovec iov;
 	unsigned int cflags;
 	unsigned flags;
-	int ret, min_ret = 0;
+	int ret, min_ret = 0, nr_iovs;
 	bool force_nonblock = issue_flags & IO_URING_F_NONBLOCK;
 	size_t len = sr->len;
 
@@ -803,18 +833,29 @@ int io_recv(struct io_kiocb *req, unsigned int issue_flags)
 		return -ENOTSOCK;
 
 retry_multishot:
-	if (io_do_buffer_select(req)) {
-		void __user *buf;
+	nr_iovs = 1;
+	if (io_do_buffer_select(req) && (sr->flags & IORING_RECVSEND_BUNDLE)) {
+		nr_iovs = io_buffers_select(req, iovs, ARRAY_SIZE(iovs),
+					    sr->len, issue_flags);
+		if (nr_iovs < 0)
+			return nr_iovs;
+		iov_iter_init(&msg.msg_iter, READ, iovs, nr_iovs,
+			      iov_length(iovs, nr_iovs));
+	} else {
+		if (io_do_buffer_select(req)) {
+			void __user *buf;
 
-		buf = io_buffer_select(req, &len, issue_flags);
-		if (!buf)
-			return -ENOBUFS;
-		sr->buf = buf;
-	}
+			buf = io_buffer_select(req, &len, issue_flags);
+			if (!buf)
+				return -ENOBUFS;
+			sr->buf = buf;
+		}
 
-	ret = import_single_range(READ, sr->buf, len, &iov, &msg.msg_iter);
-	if (unlikely(ret))
-		goto out_free;
+		ret = import_single_range(READ, sr->buf, len, &iovs[0],
+					  &msg.msg_iter);
+		if (unlikely(ret))
+			goto out_free;
+	}
 
 	msg.msg_name = NULL;
 	msg.msg_namelen = 0;
@@ -863,7 +904,8 @@ int io_recv(struct io_kiocb *req, unsigned int issue_flags)
 	else
 		io_kbuf_recycle(req, issue_flags);
 
-	cflags = io_put_kbuf(req, issue_flags);
+	cflags = io_put_kbufs(req, io_bundle_nbufs(iovs, nr_iovs, ret),
+			      issue_flags);
 	if (msg.msg_inq)
 		cflags |= IORING_CQE_F_SOCK_NONEMPTY;
 
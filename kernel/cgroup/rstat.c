@@ -141,51 +141,133 @@ static struct cgroup *cgroup_rstat_cpu_pop_updated(struct cgroup *pos,
 	return pos;
 }
 
-/* see cgroup_rstat_flush() */
-static void cgroup_rstat_flush_locked(struct cgroup *cgrp, bool may_sleep)
-	__releases(&cgroup_rstat_lock) __acquires(&cgroup_rstat_lock)
+/*
+ * The flush in flight.  Flushing walks the updated trees one CPU at a time
+ * and cgroup_rstat_lock is only held for a single CPU, so that readers and
+ * other flushers don't stall behind a walk over every CPU.  A flusher of
+ * @root or of one of its descendants doesn't start a walk of its own but
+ * joins the one in flight and claims CPUs from @next_cpu along with the
+ * other flushers.  @root is NULL when there is no flush in flight.
+ * Protected by cgroup_rstat_lock.
+ */
+static struct cgroup_rstat_flush {
+	struct cgroup		*root;
+	unsigned int		seq;
+	int			next_cpu;
+} cgroup_rstat_flush_state;
+
+/* flush the updated tree of @cgrp on @cpu */
+static void cgroup_rstat_flush_cpu(struct cgroup *cgrp, int cpu)
 {
+	raw_spinlock_t *cpu_lock = per_cpu_ptr(&cgroup_rstat_cpu_lock, cpu);
+	struct cgroup *pos = NULL;
+	unsigned long flags;
+
+	lockdep_assert_held(&cgroup_rstat_lock);
+
+	/*
+	 * The _irqsave() is needed because cgroup_rstat_lock is
+	 * spinlock_t which is a sleeping lock on PREEMPT_RT. Acquiring
+	 * this lock with the _irq() suffix only disables interrupts on
+	 * a non-PREEMPT_RT kernel. The raw_spinlock_t below disables
+	 * interrupts on both configurations. The _irqsave() ensures
+	 * that interrupts are always disabled and later restored.
+	 */
+	raw_spin_lock_irqsave(cpu_lock, flags);
+	while ((pos = cgroup_rstat_cpu_pop_updated(pos, cgrp, cpu))) {
+		struct cgroup_subsys_state *css;
+
+		cgroup_base_stat_flush(pos, cpu);
+
+		rcu_read_lock();
+		list_for_each_entry_rcu(css, &pos->rstat_css_list,
+					rstat_css_node)
+			css->ss->css_rstat_flush(css, cpu);
+		rcu_read_unlock();
+	}
+	raw_spin_unlock_irqrestore(cpu_lock, flags);
+}
+
+/*
+ * Claim the next CPU of the flush @seq.  Returns nr_cpu_ids once all CPUs
+ * have been claimed.  As CPUs are claimed and flushed within the same
+ * cgroup_rstat_lock section, every claimed CPU has been flushed by then.
+ */
+static int cgroup_rstat_flush_claim(unsigned int seq)
+{
+	struct cgroup_rstat_flush *fl = &cgroup_rstat_flush_state;
 	int cpu;
 
 	lockdep_assert_held(&cgroup_rstat_lock);
 
-	for_each_possible_cpu(cpu) {
-		raw_spinlock_t *cpu_lock = per_cpu_ptr(&cgroup_rstat_cpu_lock,
-						       cpu);
-		struct cgroup *pos = NULL;
-		unsigned long flags;
+	if (!fl->root || fl->seq != seq)
+		return nr_cpu_ids;
+
+	cpu = cpumask_next(fl->next_cpu - 1, cpu_possible_mask);
+	if (cpu >= nr_cpu_ids) {
+		fl->root = NULL;
+		return nr_cpu_ids;
+	}
+
+	fl->next_cpu = cpu + 1;
+	return cpu;
+}
+
+/* drop cgroup_rstat_lock between CPUs and yield if @may_sleep */
+static void cgroup_rstat_flush_relax(bool may_sleep, unsigned long *flags)
+	__releases(&cgroup_rstat_lock) __acquires(&cgroup_rstat_lock)
+{
+	spin_unlock_irqrestore(&cgroup_rstat_lock, *flags);
+	if (may_sleep)
+		cond_resched();
+	spin_lock_irqsave(&cgroup_rstat_lock, *flags);
+}
+
+/* see cgroup_rstat_flush() */
+static void __cgroup_rstat_flush(struct cgroup *cgrp, bool may_sleep)
+{
+	struct cgroup_rstat_flush *fl = &cgroup_rstat_flush_state;
+	bool shared = true;
+	unsigned long flags;
+	unsigned int seq;
+	int cpu, first;
 
+	spin_lock_irqsave(&cgroup_rstat_lock, flags);
+
+	if (!fl->root) {
+		fl->root = cgrp;
+		fl->seq++;
+		fl->next_cpu = 0;
+		first = 0;
+	} else if (cgroup_is_descendant(cgrp, fl->root)) {
 		/*
-		 * The _irqsave() is needed because cgroup_rstat_lock is
-		 * spinlock_t which is a sleeping lock on PREEMPT_RT. Acquiring
-		 * this lock with the _irq() suffix only disables interrupts on
-		 * a non-PREEMPT_RT kernel. The raw_spinlock_t below disables
-		 * interrupts on both configurations. The _irqsave() ensures
-		 * that interrupts are always disabled and later restored.
+		 * Piggyback on the flush of an ancestor.  The CPUs it has
+		 * already claimed may have been flushed before our updates
+		 * and are swept below.
 		 */
-		raw_spin_lock_irqsave(cpu_lock, flags);
-		while ((pos = cgroup_rstat_cpu_pop_updated(pos, cgrp, cpu))) {
-			struct cgroup_subsys_state *css;
-
-			cgroup_base_stat_flush(pos, cpu);
+		first = fl->next_cpu;
+	} else {
+		/* an unrelated subtree is being flushed, walk all CPUs */
+		shared = false;
+		first = nr_cpu_ids;
+	}
+	seq = fl->seq;
 
-			rcu_read_lock();
-			list_for_each_entry_rcu(css, &pos->rstat_css_list,
-						rstat_css_node)
-				css->ss->css_rstat_flush(css, cpu);
-			rcu_read_unlock();
-		}
-		raw_spin_unlock_irqrestore(cpu_lock, flags);
-
-		/* if @may_sleep, play nice and yield if necessary */
-		if (may_sleep && (need_resched() ||
-				  spin_needbreak(&cgroup_rstat_lock))) {
-			spin_unlock_irq(&cgroup_rstat_lock);
-			if (!cond_resched())
-				cpu_relax();
-			spin_lock_irq(&cgroup_rstat_lock);
+	if (shared) {
+		while ((cpu = cgroup_rstat_flush_claim(seq)) < nr_cpu_ids) {
+			cgroup_rstat_flush_cpu(fl->root, cpu);
+			cgroup_rstat_flush_relax(may_sleep, &flags);
 		}
 	}
+
+	for_each_possible_cpu(cpu) {
+		if (cpu >= first)
+			break;
+		cgroup_rstat_flush_cpu(cgrp, cpu);
+		cgroup_rstat_flush_relax(may_sleep, &flags);
+	}
+
+	spin_unlock_irqrestore(&cgroup_rstat_lock, flags);
 }
 
 /**
@@ -199,15 +281,15 @@ static void cgroup_rstat_flush_locked(struct cgroup *cgrp, bool may_sleep)
  * This also gets all cgroups in the subtree including @cgrp off the
  * ->updated_children lists.
  *
+ * Concurrent flushers of @cgrp and its descendants split the CPUs between
+ * them rather than each walking all of them.
+ *
  * This function may block.
  */
 void cgroup_rstat_flush(struct cgroup *cgrp)
 {
 	might_sleep();
-
-	spin_lock_irq(&cgroup_rstat_lock);
-	cgroup_rstat_flush_locked(cgrp, true);
-	spin_unlock_irq(&cgroup_rstat_lock);
+	__cgroup_rstat_flush(cgrp, true);
 }
 
 /**
@@ -218,11 +300,7 @@ void cgroup_rstat_flush(struct cgroup *cgrp)
  */
 void cgroup_rstat_flush_irqsafe(struct cgroup *cgrp)
 {
-	unsigned long flags;
-
-	spin_lock_irqsave(&cgroup_rstat_lock, flags);
-	cgroup_rstat_flush_locked(cgrp, false);
-	spin_unlock_irqrestore(&cgroup_rstat_lock, flags);
+	__cgroup_rstat_flush(cgrp, false);
 }
 
 /**
@@ -238,8 +316,8 @@ void cgroup_rstat_flush_hold(struct cgroup *cgrp)
 	__acquires(&cgroup_rstat_lock)
 {
 	might_sleep();
+	__cgroup_rstat_flush(cgrp, true);
 	spin_lock_irq(&cgroup_rstat_lock);
-	cgroup_rstat_flush_locked(cgrp, true);
 }
 
 /**
@@ -55,6 +55,7 @@
 #include <linux/pgtable.h>
 #include <linux/buildid.h>
 #include <linux/task_work.h>
+#include <linux/jhash.h>
 
 #include "internal.h"
 
@@ -2269,6 +2270,9 @@ event_sched_out(struct perf_event *event,
 	event->pmu->del(event, 0);
 	event->oncpu = -1;
 
+	if (event->sample_batch)
+		perf_output_batch_flush(event);
+
 	if (event->pending_disable) {
 		event->pending_disable = 0;
 		perf_cgroup_event_disable(event, ctx);
@@ -2327,6 +2331,43 @@ group_sched_out(struct perf_event *group_event,
 	perf_pmu_enable(ctx->pmu);
 }
 
+static void perf_hist_flush(struct perf_event *event);
+static void perf_hist_free(struct perf_event *event);
+
+/*
+ * The ring buffer of an event is only ever written on event->cpu or, for a
+ * per task event with cpu == -1, on the CPU the task runs on; and so must
+ * the PERF_RECORD_HIST records be.  The cross CPU calls below get us the
+ * latter, the former needs an IPI of its own: perf_hist_flush_cpu().
+ */
+static inline bool perf_hist_flush_here(struct perf_event *event)
+{
+	/* inherited events share the histogram of their parent */
+	if (!event->sample_hist || event->parent)
+		return false;
+
+	return event->cpu == -1 || event->cpu == smp_processor_id();
+}
+
+static int __perf_hist_flush_cpu(void *info)
+{
+	perf_hist_flush(info);
+	return 0;
+}
+
+static void perf_hist_flush_cpu(struct perf_event *event)
+{
+	if (!event->sample_hist || event->parent || event->cpu == -1)
+		return;
+
+	/* nobody writes the ring buffer on an offline CPU */
+	if (cpu_function_call(event->cpu, __perf_hist_flush_cpu, event)) {
+		local_irq_disable();
+		perf_hist_flush(event);
+		local_irq_enable();
+	}
+}
+
 #define DETACH_GROUP	0x01UL
 #define DETACH_CHILD	0x02UL
 #define DETACH_DEAD	0x04UL
@@ -2365,6 +2406,9 @@ __perf_remove_from_context(struct perf_event *event,
 	if (flags & DETACH_DEAD)
 		event->state = PERF_EVENT_STATE_DEAD;
 
+	if (perf_hist_flush_here(event))
+		perf_hist_flush(event);
+
 	if (!ctx->nr_events && ctx->is_active) {
 		if (ctx == &cpuctx->ctx)
 			update_cgrp_time_from_cpuctx(cpuctx, true);
@@ -2408,11 +2452,13 @@ static void perf_remove_from_context(struct perf_event *event, unsigned long fla
 		__perf_remove_from_context(event, __get_cpu_context(ctx),
 					   ctx, (void *)flags);
 		raw_spin_unlock_irq(&ctx->lock);
-		return;
+		goto flush;
 	}
 	raw_spin_unlock_irq(&ctx->lock);
 
 	event_function_call(event, __perf_remove_from_context, (void *)flags);
+flush:
+	perf_hist_flush_cpu(event);
 }
 
 /*
@@ -2438,6 +2484,9 @@ static void __perf_event_disable(struct perf_event *event,
 
 	perf_event_set_state(event, PERF_EVENT_STATE_OFF);
 	perf_cgroup_event_disable(event, ctx);
+
+	if (perf_hist_flush_here(event))
+		perf_hist_flush(event);
 }
 
 /*
@@ -2466,6 +2515,7 @@ static void _perf_event_disable(struct perf_event *event)
 	raw_spin_unlock_irq(&ctx->lock);
 
 	event_function_call(event, __perf_event_disable, NULL);
+	perf_hist_flush_cpu(event);
 }
 
 void perf_event_disable_local(struct perf_event *event)
@@ -4975,6 +5025,9 @@ static void _free_event(struct perf_event *event)
 
 	security_perf_event_free(event);
 
+	if (event->sample_hist && !event->parent)
+		perf_hist_free(event);
+
 	if (event->rb) {
 		/*
 		 * Can happen when we close an event with re-directed output.
@@ -4998,6 +5051,7 @@ static void _free_event(struct perf_event *event)
 	perf_event_free_bpf_prog(event);
 	perf_addr_filters_splice(event, NULL);
 	kfree(event->addr_filter_ranges);
+	perf_sample_batch_free(event);
 
 	if (event->destroy)
 		event->destroy(event);
@@ -5191,6 +5245,12 @@ int perf_event_release_kernel(struct perf_event *event)
 	}
 	mutex_unlock(&event->child_mutex);
 
+	/*
+	 * The children counted into our histogram until they were removed
+	 * above, write out what they added since our own removal.
+	 */
+	perf_hist_flush_cpu(event);
+
 	list_for_each_entry_safe(child, tmp, &free_list, child_list) {
 		void *var = &child->ctx->refcount;
 
@@ -5472,6 +5532,24 @@ static void _perf_event_reset(struct perf_event *event)
 	perf_event_update_userpage(event);
 }
 
+static void __perf_event_flush_hist(struct perf_event *event,
+				   struct perf_cpu_context *cpuctx,
+				   struct perf_event_context *ctx,
+				   void *info)
+{
+	if (perf_hist_flush_here(event))
+		perf_hist_flush(event);
+}
+
+static void _perf_event_flush_hist(struct perf_event *event)
+{
+	if (!event->sample_hist)
+		return;
+
+	event_function_call(event, __perf_event_flush_hist, NULL);
+	perf_hist_flush_cpu(event);
+}
+
 /* Assume it's not an event with inherit set. */
 u64 perf_event_pause(struct perf_event *event, bool reset)
 {
@@ -5639,6 +5717,9 @@ static long _perf_ioctl(struct perf_event *event, unsigned int cmd, unsigned lon
 	case PERF_EVENT_IOC_RESET:
 		func = _perf_event_reset;
 		break;
+	case PERF_EVENT_IOC_FLUSH_HIST:
+		func = _perf_event_flush_hist;
+		break;
 
 	case PERF_EVENT_IOC_REFRESH:
 		return _perf_event_refresh(event, arg);
@@ -7224,7 +7305,8 @@ void perf_output_sample(struct perf_output_handle *handle,
 			perf_aux_sample_output(event, handle, data);
 	}
 
-	if (!event->attr.watermark) {
+	/* staged records are accounted when they are committed */
+	if (!event->attr.watermark && handle->rb) {
 		int wakeup_events = event->attr.wakeup_events;
 
 		if (wakeup_events) {
@@ -7556,6 +7638,173 @@ void perf_prepare_sample(struct perf_event_header *header,
 	WARN_ON_ONCE(header->size & 7);
 }
 
+/*
+ * In-kernel sample aggregation: samples of an event with attr.sample_hist
+ * are counted in a small open addressed hash table keyed by pid and stack
+ * instead of being written out one by one.  Entries are written out as
+ * PERF_RECORD_HIST when they are evicted to make room for a new key, and
+ * all of them on flush.
+ */
+static void perf_hist_output(struct perf_event *event,
+			     struct perf_sample_data *data,
+			     struct perf_hist_entry *entry)
+{
+	struct perf_output_handle handle;
+	struct {
+		struct perf_event_header	header;
+		u64				count;
+		u32				pid;
+		u32				nr;
+	} hist_event = {
+		.header = {
+			.type = PERF_RECORD_HIST,
+			.misc = 0,
+			.size = sizeof(hist_event) + entry->nr * sizeof(u64),
+		},
+		.count	= entry->count,
+		.pid	= entry->pid,
+		.nr	= entry->nr,
+	};
+
+	perf_event_header__init_id(&hist_event.header, data, event);
+
+	if (perf_output_begin(&handle, data, event, hist_event.header.size))
+		return;
+
+	perf_output_put(&handle, hist_event);
+	perf_output_copy(&handle, entry->ips, entry->nr * sizeof(u64));
+	perf_event__output_id_sample(event, &handle, data);
+
+	perf_output_end(&handle);
+}
+
+/*
+ * Count the sample in the histogram of @event.  Returns an error if the
+ * sample has to be written out as usual instead, because we interrupted
+ * an update of the histogram.
+ */
+static int perf_hist_add(struct perf_event *event,
+			 struct perf_sample_data *data,
+			 struct pt_regs *regs)
+{
+	u64 sample_type = event->attr.sample_type;
+	struct perf_hist *hist = event->sample_hist;
+	struct perf_hist_entry *entry, *victim = NULL;
+	u32 hash, pid;
+	u64 ip, *ips;
+	int i, nr;
+
+	if (READ_ONCE(hist->busy))
+		return -EBUSY;
+
+	WRITE_ONCE(hist->busy, 1);
+	barrier();
+
+	if (sample_type & PERF_SAMPLE_CALLCHAIN) {
+		if (!(sample_type & __PERF_SAMPLE_CALLCHAIN_EARLY))
+			data->callchain = perf_callchain(event, regs);
+
+		ips = data->callchain->ips;
+		nr = min_t(u64, data->callchain->nr, PERF_HIST_MAX_STACK);
+	} else {
+		ip = perf_instruction_pointer(regs);
+		ips = &ip;
+		nr = 1;
+	}
+
+	pid = perf_event_pid(event, current);
+	hash = jhash2((u32 *)ips, nr * 2, pid);
+
+	/*
+	 * Entries are only ever replaced, never removed on their own, so the
+	 * first unused entry terminates the probe sequence.
+	 */
+	for (i = 0; i < PERF_HIST_PROBES; i++) {
+		entry = &hist->entries[(hash + i) & hist->mask];
+
+		if (!entry->count) {
+			victim = entry;
+			goto insert;
+		}
+
+		if (entry->hash == hash && entry->pid == pid &&
+		    entry->nr == nr &&
+		    !memcmp(entry->ips, ips, nr * sizeof(u64))) {
+			entry->count++;
+			goto out;
+		}
+
+		if (!victim || entry->count < victim->count)
+			victim = entry;
+	}
+
+	/* evict the least used entry of the probe sequence */
+	perf_hist_output(event, data, victim);
+
+insert:
+	victim->count = 1;
+	victim->hash = hash;
+	victim->pid = pid;
+	victim->nr = nr;
+	memcpy(victim->ips, ips, nr * sizeof(u64));
+out:
+	barrier();
+	WRITE_ONCE(hist->busy, 0);
+
+	return 0;
+}
+
+/*
+ * Write out and clear the histogram of @event, with IRQs disabled on the CPU
+ * its ring buffer is written on, see perf_hist_flush_here().
+ */
+static void perf_hist_flush(struct perf_event *event)
+{
+	struct perf_hist *hist = event->sample_hist;
+	struct perf_sample_data data;
+	int i;
+
+	if (READ_ONCE(hist->busy))
+		return;
+
+	WRITE_ONCE(hist->busy, 1);
+	barrier();
+
+	perf_sample_data_init(&data, 0, 0);
+
+	for (i = 0; i <= hist->mask; i++) {
+		struct perf_hist_entry *entry = &hist->entries[i];
+
+		if (!entry->count)
+			continue;
+
+		perf_hist_output(event, &data, entry);
+		entry->count = 0;
+	}
+
+	barrier();
+	WRITE_ONCE(hist->busy, 0);
+}
+
+/*
+ * Free the histogram of @event, counting the samples which never made it
+ * out, because the last flush found the histogram busy, as lost.
+ */
+static void perf_hist_free(struct perf_event *event)
+{
+	struct perf_hist *hist = event->sample_hist;
+	u64 lost = 0;
+	int i;
+
+	for (i = 0; i <= hist->mask; i++)
+		lost += hist->entries[i].count;
+
+	if (lost)
+		atomic64_add(lost, &event->lost_samples);
+
+	kvfree(hist);
+}
+
 static __always_inline int
 __perf_event_output(struct perf_event *event,
 		    struct perf_sample_data *data,
@@ -7572,8 +7821,25 @@ __perf_event_output(struct perf_event *event,
 	/* protect the callchain buffers */
 	rcu_read_lock();
 
+	if (event->sample_hist && !perf_hist_add(event, data, regs)) {
+		err = 0;
+		goto exit;
+	}
+
 	perf_prepare_sample(&header, data, event, regs);
 
+	if (event->sample_batch) {
+		err = perf_output_batch_begin(&handle, event, header.size);
+		if (!err) {
+			perf_output_sample(&handle, &header, data, event);
+			perf_output_batch_end(&handle);
+			goto exit;
+		}
+		/* only records too large to be staged go out directly */
+		if (err != -E2BIG)
+			goto exit;
+	}
+
 	err = output_begin(&handle, data, event, header.size);
 	if (err)
 		goto exit;
@@ -11721,6 +11987,13 @@ perf_event_alloc(struct perf_event_attr *attr, int cpu,
 	if (attr->inherit && (attr->sample_type & PERF_SAMPLE_READ))
 		goto err_ns;
 
+	/*
+	 * Inherited events count into the histogram of their parent, which
+	 * is only safe when they all run on the same CPU; see perf_hist_add().
+	 */
+	if (attr->inherit && attr->sample_hist && cpu == -1)
+		goto err_ns;
+
 	if (!has_branch_stack(event))
 		event->attr.branch_sample_type = 0;
 
@@ -11782,6 +12055,28 @@ perf_event_alloc(struct perf_event_attr *attr, int cpu,
 		event->addr_filters_gen = 1;
 	}
 
+	if (event->attr.sample_batch) {
+		err = perf_sample_batch_alloc(event, node);
+		if (err)
+			goto err_addr_filters;
+	}
+
+	if (parent_event) {
+		event->sample_hist = parent_event->sample_hist;
+	} else if (event->attr.sample_hist) {
+		unsigned int nr = attr->sample_hist_entries ?: PERF_HIST_ENTRIES;
+		struct perf_hist *hist;
+
+		hist = kvzalloc_node(struct_size(hist, entries, nr),
+				     GFP_KERNEL_ACCOUNT, node);
+		if (!hist) {
+			err = -ENOMEM;
+			goto err_addr_filters;
+		}
+		hist->mask = nr - 1;
+		event->sample_hist = hist;
+	}
+
 	if (!event->parent) {
 		if (event->attr.sample_type & PERF_SAMPLE_CALLCHAIN) {
 			err = get_callchain_buffers(attr->sample_max_stack);
@@ -11805,6 +12100,9 @@ perf_event_alloc(struct perf_event_attr *attr, int cpu,
 			put_callchain_buffers();
 	}
 err_addr_filters:
+	if (!event->parent)
+		kvfree(event->sample_hist);
+	perf_sample_batch_free(event);
 	kfree(event->addr_filter_ranges);
 
 err_per_task:
@@ -11854,7 +12152,7 @@ static int perf_copy_attr(struct perf_event_attr __user *uattr,
 
 	attr->size = size;
 
-	if (attr->__reserved_1 || attr->__reserved_2 || attr->__reserved_3)
+	if (attr->__reserved_1 || attr->__reserved_2)
 		return -EINVAL;
 
 	if (attr->sample_type & ~(PERF_SAMPLE_MAX-1))
@@ -11943,6 +12241,23 @@ static int perf_copy_attr(struct perf_event_attr __user *uattr,
 	if (attr->sigtrap && !attr->remove_on_exec)
 		return -EINVAL;
 
+	/* AUX samples are copied straight out of the AUX buffer */
+	if (attr->sample_batch && (attr->sample_type & PERF_SAMPLE_AUX))
+		return -EINVAL;
+
+	if (attr->sample_hist) {
+		/* a counting event has no samples to aggregate */
+		if (!attr->sample_period)
+			return -EINVAL;
+
+		if (attr->sample_hist_entries &&
+		    (!is_power_of_2(attr->sample_hist_entries) ||
+		     attr->sample_hist_entries > PERF_HIST_MAX_ENTRIES))
+			return -EINVAL;
+	} else if (attr->sample_hist_entries) {
+		return -EINVAL;
+	}
+
 out:
 	return ret;
 
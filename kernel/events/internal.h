@@ -5,6 +5,7 @@
 #include <linux/hardirq.h>
 #include <linux/uaccess.h>
 #include <linux/refcount.h>
+#include <linux/timer.h>
 
 /* Buffer handling */
 
@@ -58,6 +59,49 @@ struct perf_buffer {
 	void				*data_pages[];
 };
 
+/* Sample batching, see attr.sample_batch */
+
+#define PERF_SAMPLE_BATCH_SIZE		1024
+
+struct perf_sample_batch {
+	unsigned int			busy;		/* staging a record  */
+	unsigned int			size;		/* bytes staged      */
+	unsigned int			nr;		/* records staged    */
+	unsigned long			stamp;		/* jiffies of first  */
+	struct perf_event		*event;
+	struct irq_work			work;		/* arms @timer       */
+	struct timer_list		timer;		/* commits when idle */
+	u8				data[PERF_SAMPLE_BATCH_SIZE];
+};
+
+extern int perf_sample_batch_alloc(struct perf_event *event, int node);
+extern void perf_sample_batch_free(struct perf_event *event);
+extern int perf_output_batch_begin(struct perf_output_handle *handle,
+				   struct perf_event *event, unsigned int size);
+extern void perf_output_batch_end(struct perf_output_handle *handle);
+extern void perf_output_batch_flush(struct perf_event *event);
+
+/* In-kernel sample aggregation, see attr.sample_hist */
+
+#define PERF_HIST_ENTRIES		256		/* default, power of two */
+#define PERF_HIST_MAX_ENTRIES		4096		/* about 1MiB */
+#define PERF_HIST_PROBES		8
+#define PERF_HIST_MAX_STACK		32
+
+struct perf_hist_entry {
+	u64				count;		/* 0 if unused       */
+	u32				hash;
+	u32				pid;
+	u64				nr;
+	u64				ips[PERF_HIST_MAX_STACK];
+};
+
+struct perf_hist {
+	unsigned int			busy;		/* updating entries  */
+	unsigned int			mask;		/* nr entries - 1    */
+	struct perf_hist_entry		entries[];
+};
+
 extern void rb_free(struct perf_buffer *rb);
 
 static inline void rb_free_rcu(struct rcu_head *rcu_head)
@@ -149,7 +149,7 @@ static __always_inline int
 __perf_output_begin(struct perf_output_handle *handle,
 		    struct perf_sample_data *data,
 		    struct perf_event *event, unsigned int size,
-		    bool backward)
+		    unsigned int nr, bool backward)
 {
 	struct perf_buffer *rb;
 	unsigned long tail, offset, head;
@@ -173,8 +173,8 @@ __perf_output_begin(struct perf_output_handle *handle,
 
 	if (unlikely(rb->paused)) {
 		if (rb->nr_pages) {
-			local_inc(&rb->lost);
-			atomic64_inc(&event->lost_samples);
+			local_add(nr, &rb->lost);
+			atomic64_add(nr, &event->lost_samples);
 		}
 		goto out;
 	}
@@ -255,8 +255,8 @@ __perf_output_begin(struct perf_output_handle *handle,
 	return 0;
 
 fail:
-	local_inc(&rb->lost);
-	atomic64_inc(&event->lost_samples);
+	local_add(nr, &rb->lost);
+	atomic64_add(nr, &event->lost_samples);
 	perf_output_put_handle(handle);
 out:
 	rcu_read_unlock();
@@ -264,26 +264,46 @@ __perf_output_begin(struct perf_output_handle *handle,
 	return -ENOSPC;
 }
 
+/*
+ * A record written directly must not overtake the samples @event has
+ * staged, see perf_output_batch_begin(); commit those first.  Only the CPU
+ * @event is active on stages records, and scheduling it out commits them.
+ */
+static __always_inline void perf_output_batch_order(struct perf_event *event)
+{
+	unsigned long flags;
+
+	if (likely(!event->sample_batch))
+		return;
+
+	local_irq_save(flags);
+	if (READ_ONCE(event->oncpu) == smp_processor_id())
+		perf_output_batch_flush(event);
+	local_irq_restore(flags);
+}
+
 int perf_output_begin_forward(struct perf_output_handle *handle,
 			      struct perf_sample_data *data,
 			      struct perf_event *event, unsigned int size)
 {
-	return __perf_output_begin(handle, data, event, size, false);
+	perf_output_batch_order(event);
+	return __perf_output_begin(handle, data, event, size, 1, false);
 }
 
 int perf_output_begin_backward(struct perf_output_handle *handle,
 			       struct perf_sample_data *data,
 			       struct perf_event *event, unsigned int size)
 {
-	return __perf_output_begin(handle, data, event, size, true);
+	perf_output_batch_order(event);
+	return __perf_output_begin(handle, data, event, size, 1, true);
 }
 
 int perf_output_begin(struct perf_output_handle *handle,
 		      struct perf_sample_data *data,
 		      struct perf_event *event, unsigned int size)
 {
-
-	return __perf_output_begin(handle, data, event, size,
+	perf_output_batch_order(event);
+	return __perf_output_begin(handle, data, event, size, 1,
 				   unlikely(is_write_backward(event)));
 }
 
@@ -305,6 +325,217 @@ void perf_output_end(struct perf_output_handle *handle)
 	rcu_read_unlock();
 }
 
+/*
+ * Sample batching: rather than paying for perf_output_begin() and
+ * perf_output_end() on every sample, the records of an event with
+ * attr.sample_batch are staged in event->sample_batch and committed to the
+ * ring buffer in one go, with a single head update.
+ *
+ * The staged records are committed when the next one doesn't fit, before
+ * any other record of the event is written directly, when the first staged
+ * one is older than a tick and when the event is scheduled out. The age is
+ * checked when the next record is staged and, for an event which goes
+ * quiet, by @batch->timer. Readers see the samples late, but in order with
+ * respect to the other records of the event; a sample which interrupted
+ * the staging of another one is counted as lost rather than written ahead
+ * of it. The one exception is a side-band record, e.g. PERF_RECORD_THROTTLE,
+ * written from NMI while a sample is being staged: it can't wait for the
+ * interrupted context and lands ahead of the staged samples.
+ */
+static void __perf_output_batch_commit(struct perf_event *event,
+				       struct perf_sample_batch *batch)
+{
+	struct perf_output_handle handle;
+	struct perf_sample_data data;
+	int wakeup_events, events;
+
+	perf_sample_data_init(&data, 0, 0);
+
+	if (__perf_output_begin(&handle, &data, event, batch->size, batch->nr,
+				unlikely(is_write_backward(event))))
+		goto out;
+
+	__output_copy(&handle, batch->data, batch->size);
+
+	/* see perf_output_sample(), which skips staged records */
+	wakeup_events = handle.event->attr.wakeup_events;
+	if (!handle.event->attr.watermark && wakeup_events) {
+		events = local_add_return(batch->nr, &handle.rb->events);
+		if (events >= wakeup_events) {
+			local_sub(events - events % wakeup_events,
+				  &handle.rb->events);
+			local_inc(&handle.rb->wakeup);
+		}
+	}
+
+	perf_output_end(&handle);
+out:
+	batch->size = 0;
+	batch->nr = 0;
+}
+
+static void perf_output_batch_lost(struct perf_event *event)
+{
+	struct perf_buffer *rb;
+
+	rcu_read_lock();
+	if (event->parent)
+		event = event->parent;
+
+	rb = rcu_dereference(event->rb);
+	if (rb && rb->nr_pages) {
+		local_inc(&rb->lost);
+		atomic64_inc(&event->lost_samples);
+	}
+	rcu_read_unlock();
+}
+
+/*
+ * Staging the first record of a batch may happen in NMI context, arm the
+ * timer which commits the batch should the event go quiet from here.
+ */
+static void perf_sample_batch_work(struct irq_work *work)
+{
+	struct perf_sample_batch *batch =
+		container_of(work, struct perf_sample_batch, work);
+
+	mod_timer(&batch->timer, jiffies + 1);
+}
+
+static void perf_sample_batch_timer(struct timer_list *t)
+{
+	struct perf_sample_batch *batch = from_timer(batch, t, timer);
+	struct perf_event *event = batch->event;
+	unsigned long flags;
+
+	/*
+	 * Only the CPU the event is active on stages records. If the event
+	 * isn't active here, it was scheduled out, which committed the batch.
+	 */
+	local_irq_save(flags);
+	if (READ_ONCE(event->oncpu) == smp_processor_id())
+		perf_output_batch_flush(event);
+	local_irq_restore(flags);
+}
+
+int perf_sample_batch_alloc(struct perf_event *event, int node)
+{
+	struct perf_sample_batch *batch;
+
+	batch = kzalloc_node(sizeof(*batch), GFP_KERNEL, node);
+	if (!batch)
+		return -ENOMEM;
+
+	batch->event = event;
+	init_irq_work(&batch->work, perf_sample_batch_work);
+	timer_setup(&batch->timer, perf_sample_batch_timer, TIMER_PINNED);
+	event->sample_batch = batch;
+
+	return 0;
+}
+
+/* Called once @event can no longer overflow. */
+void perf_sample_batch_free(struct perf_event *event)
+{
+	struct perf_sample_batch *batch = event->sample_batch;
+
+	if (!batch)
+		return;
+
+	irq_work_sync(&batch->work);
+	del_timer_sync(&batch->timer);
+	kfree(batch);
+	event->sample_batch = NULL;
+}
+
+/**
+ * perf_output_batch_begin - stage a record of @size bytes
+ * @handle: the handle to write the record through
+ * @event: the event the record belongs to
+ * @size: the size of the record
+ *
+ * Returns 0 when the record can be written through @handle, which must be
+ * followed by perf_output_batch_end().  Returns -E2BIG when the record is
+ * too large to be staged and has to go through perf_output_begin() instead,
+ * the staged records have been committed ahead of it.  Returns -EBUSY when
+ * @event is already staging a record in a context we interrupted, the
+ * record is then counted as lost.
+ */
+int perf_output_batch_begin(struct perf_output_handle *handle,
+			    struct perf_event *event, unsigned int size)
+{
+	struct perf_sample_batch *batch = event->sample_batch;
+
+	if (READ_ONCE(batch->busy)) {
+		perf_output_batch_lost(event);
+		return -EBUSY;
+	}
+
+	WRITE_ONCE(batch->busy, 1);
+	barrier();
+
+	/*
+	 * Never let a record fill the staging area up to its end, or
+	 * __output_copy() would go look for the next page in handle->rb.
+	 */
+	if (size >= PERF_SAMPLE_BATCH_SIZE) {
+		if (batch->nr)
+			__perf_output_batch_commit(event, batch);
+		barrier();
+		WRITE_ONCE(batch->busy, 0);
+		return -E2BIG;
+	}
+
+	if (batch->nr && (batch->size + size >= PERF_SAMPLE_BATCH_SIZE ||
+			  time_after(jiffies, batch->stamp)))
+		__perf_output_batch_commit(event, batch);
+
+	if (!batch->nr) {
+		batch->stamp = jiffies;
+		irq_work_queue(&batch->work);
+	}
+
+	handle->event = event;
+	handle->rb = NULL;
+	handle->wakeup = 0;
+	handle->aux_flags = 0;
+	handle->addr = batch->data + batch->size;
+	handle->size = PERF_SAMPLE_BATCH_SIZE - batch->size;
+	handle->page = 0;
+
+	batch->size += size;
+	batch->nr++;
+
+	return 0;
+}
+
+void perf_output_batch_end(struct perf_output_handle *handle)
+{
+	barrier();
+	WRITE_ONCE(handle->event->sample_batch->busy, 0);
+}
+
+/**
+ * perf_output_batch_flush - commit the staged records of @event
+ * @event: the event to flush
+ *
+ * Must be called with interrupts disabled, on the CPU @event is active on
+ * or with @event stopped, such that it can't overflow on another CPU.
+ */
+void perf_output_batch_flush(struct perf_event *event)
+{
+	struct perf_sample_batch *batch = event->sample_batch;
+
+	if (!batch->nr || READ_ONCE(batch->busy))
+		return;
+
+	WRITE_ONCE(batch->busy, 1);
+	barrier();
+	__perf_output_batch_commit(event, batch);
+	barrier();
+	WRITE_ONCE(batch->busy, 0);
+}
+
 static void
 ring_buffer_init(struct perf_buffer *rb, long watermark, int flags)
 {
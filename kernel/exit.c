@@ -755,6 +755,7 @@ void __noreturn do_exit(long code)
 
 	io_uring_files_cancel();
 	exit_signals(tsk);  /* sets PF_EXITING */
+	sched_mm_cid_deactivate(tsk);
 
 	/* sync mm's RSS info before statistics gathering */
 	if (tsk->mm)
@@ -794,6 +794,7 @@ void __mmdrop(struct mm_struct *mm)
 	check_mm(mm);
 	put_user_ns(mm->user_ns);
 	mm_pasid_drop(mm);
+	futex_hash_free(mm);
 	free_mm(mm);
 }
 EXPORT_SYMBOL_GPL(__mmdrop);
@@ -1128,6 +1129,7 @@ static struct mm_struct *mm_init(struct mm_struct *mm, struct task_struct *p,
 	spin_lock_init(&mm->page_table_lock);
 	spin_lock_init(&mm->arg_lock);
 	mm_init_cpumask(mm);
+	mm_init_cid(mm);
 	mm_init_aio(mm);
 	mm_init_owner(mm, p);
 	mm_pasid_init(mm);
@@ -1139,6 +1141,7 @@ static struct mm_struct *mm_init(struct mm_struct *mm, struct task_struct *p,
 #endif
 	mm_init_uprobes_state(mm);
 	hugetlb_count_init(mm);
+	futex_mm_init(mm);
 
 	if (current->mm) {
 		mm->flags = current->mm->flags & MMF_INIT_MASK;
@@ -1496,6 +1499,7 @@ void exit_mm_release(struct task_struct *tsk, struct mm_struct *mm)
 
 void exec_mm_release(struct task_struct *tsk, struct mm_struct *mm)
 {
+	sched_mm_cid_deactivate(tsk);
 	futex_exec_release(tsk);
 	mm_release(tsk, mm);
 }
@@ -2308,6 +2312,8 @@ static __latent_entropy struct task_struct *copy_process(
 	p->plug = NULL;
 #endif
 	futex_init_task(p);
+	if (clone_flags & CLONE_THREAD)
+		futex_hash_grow(p->mm, get_nr_threads(current) + 1);
 
 	/*
 	 * sigaltstack should be cleared when sharing the same VM
@@ -2413,6 +2419,7 @@ static __latent_entropy struct task_struct *copy_process(
 	rv_task_fork(p);
 
 	rseq_fork(p, clone_flags);
+	sched_mm_cid_fork(p);
 
 	/* Don't start children in a dying pid namespace */
 	if (unlikely(!(ns_of_pid(pid)->pid_allocated & PIDNS_ADDING))) {
@@ -3039,7 +3046,7 @@ void __init proc_caches_init(void)
 	 * dynamically sized based on the maximum CPU number this system
 	 * can have, taking hotplug into account (nr_cpu_ids).
 	 */
-	mm_size = sizeof(struct mm_struct) + cpumask_size();
+	mm_size = sizeof(struct mm_struct) + cpumask_size() + mm_cid_size();
 
 	mm_cachep = kmem_cache_create_usercopy("mm_struct",
 			mm_size, ARCH_MIN_MMSTRUCT_ALIGN,
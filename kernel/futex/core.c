@@ -37,6 +37,9 @@
 #include <linux/memblock.h>
 #include <linux/fault-inject.h>
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/prctl.h>
+#include <linux/wait_bit.h>
 
 #include "futex.h"
 #include "../locking/rtmutex_common.h"
@@ -120,6 +123,327 @@ struct futex_hash_bucket *futex_hash(union futex_key *key)
 	return &futex_queues[hash & (futex_hashsize - 1)];
 }
 
+static void futex_hash_bucket_init(struct futex_hash_bucket *hb,
+				   struct futex_private_hash *priv)
+{
+	atomic_set(&hb->waiters, 0);
+	plist_head_init(&hb->chain);
+	spin_lock_init(&hb->lock);
+#ifdef CONFIG_FUTEX_PRIVATE_HASH
+	hb->priv = priv;
+#endif
+}
+
+#ifdef CONFIG_FUTEX_PRIVATE_HASH
+/*
+ * Per process private futex hash.
+ *
+ * By default all futexes hash into the global futex_queues[], which means
+ * unrelated processes contend on the same bucket locks. A process can ask
+ * for its own hash via prctl(PR_FUTEX_HASH), which then holds the plain
+ * (non-PI) private futexes of that mm. PI futexes and the requeue PI source
+ * futex keep using the global hash, so that none of the PI state handling
+ * has to deal with buckets that move.
+ *
+ * The private hash is either of a fixed size, or grows with the number of
+ * threads in the process. Growing it rehashes all queued waiters into the
+ * new hash:
+ *
+ *   - The new hash is published and mm->futex_hash_migrating is set.
+ *   - synchronize_rcu() waits for all operations which still look at the
+ *     old hash; futex_hash_get() holds rcu_read_lock() for private buckets
+ *     until futex_hash_put().
+ *   - The waiters are moved bucket by bucket with both bucket locks held,
+ *     the same way requeue_futex() moves them, so futex_unqueue() copes
+ *     with the changing q->lock_ptr.
+ *
+ * Waiters queue on the new hash right away. Wakers have to wait for the
+ * migration to finish, as until then a waiter can be on either hash.
+ */
+struct futex_private_hash {
+	unsigned int			hash_mask;
+	struct rcu_head			rcu;
+	struct futex_hash_bucket	queues[];
+};
+
+static inline bool futex_key_is_private(union futex_key *key)
+{
+	return !(key->both.offset & (FUT_OFF_INODE | FUT_OFF_MMSHARED));
+}
+
+static struct futex_hash_bucket *
+__futex_private_hash(struct futex_private_hash *fph, union futex_key *key)
+{
+	u32 hash = jhash2((u32 *)key, offsetof(typeof(*key), both.offset) / 4,
+			  key->both.offset);
+
+	return &fph->queues[hash & fph->hash_mask];
+}
+
+/**
+ * futex_hash_get - Return the hash bucket for a non-PI futex operation
+ * @key:	Pointer to the futex key for which the hash is calculated
+ * @wake:	The caller is going to wake or requeue waiters
+ *
+ * Private futexes of a process with a private hash are hashed into that,
+ * everything else into the global hash. A private bucket is only stable
+ * until the matching futex_hash_put(), which must happen without sleeping
+ * in between. Callers which look for waiters (@wake) also wait for a
+ * resize in progress to finish, see above.
+ */
+struct futex_hash_bucket *futex_hash_get(union futex_key *key, bool wake)
+{
+	struct futex_private_hash *fph;
+	struct mm_struct *mm;
+
+	if (!futex_key_is_private(key))
+		return futex_hash(key);
+
+	mm = key->private.mm;
+	if (!rcu_access_pointer(mm->futex_phash))
+		return futex_hash(key);
+
+	/*
+	 * A waiter which already saw the new hash must not be missed by
+	 * a waker still looking at the old one. Order the futex value
+	 * update before the hash lookup, pairs with the barrier in
+	 * futex_hb_waiters_inc().
+	 */
+	if (wake)
+		smp_mb();
+
+	rcu_read_lock();
+	for (;;) {
+		fph = rcu_dereference(mm->futex_phash);
+		if (!wake)
+			break;
+		/* Pairs with rcu_assign_pointer() in futex_private_hash_set() */
+		smp_rmb();
+		if (likely(!READ_ONCE(mm->futex_hash_migrating)))
+			break;
+		rcu_read_unlock();
+		wait_var_event(&mm->futex_hash_migrating,
+			       !READ_ONCE(mm->futex_hash_migrating));
+		rcu_read_lock();
+	}
+	return __futex_private_hash(fph, key);
+}
+
+/**
+ * futex_hash_same - Return the hash bucket for a second key of an operation
+ * @hb:		The hash bucket returned by futex_hash_get() for the first key
+ * @key:	Pointer to the second futex key
+ *
+ * Both keys of an operation are of the same type, so they end up in the
+ * same hash. The bucket is released along with @hb.
+ */
+struct futex_hash_bucket *futex_hash_same(struct futex_hash_bucket *hb,
+					  union futex_key *key)
+{
+	if (hb->priv)
+		return __futex_private_hash(hb->priv, key);
+	return futex_hash(key);
+}
+
+static struct futex_private_hash *futex_private_hash_alloc(unsigned int slots)
+{
+	struct futex_private_hash *fph;
+	unsigned int i;
+
+	fph = kvzalloc(struct_size(fph, queues, slots), GFP_KERNEL_ACCOUNT);
+	if (!fph)
+		return NULL;
+
+	fph->hash_mask = slots - 1;
+	for (i = 0; i < slots; i++)
+		futex_hash_bucket_init(&fph->queues[i], fph);
+	return fph;
+}
+
+static void futex_private_rehash(struct futex_private_hash *old,
+				 struct futex_private_hash *new)
+{
+	unsigned int i;
+
+	for (i = 0; i <= old->hash_mask; i++) {
+		struct futex_hash_bucket *hb = &old->queues[i];
+		struct futex_q *this, *next;
+
+		spin_lock(&hb->lock);
+		plist_for_each_entry_safe(this, next, &hb->chain, list) {
+			struct futex_hash_bucket *nhb;
+
+			nhb = __futex_private_hash(new, &this->key);
+			spin_lock_nested(&nhb->lock, SINGLE_DEPTH_NESTING);
+			plist_del(&this->list, &hb->chain);
+			futex_hb_waiters_dec(hb);
+			futex_hb_waiters_inc(nhb);
+			plist_add(&this->list, &nhb->chain);
+			this->lock_ptr = &nhb->lock;
+			spin_unlock(&nhb->lock);
+		}
+		spin_unlock(&hb->lock);
+		cond_resched();
+	}
+}
+
+static int futex_private_hash_set(struct mm_struct *mm, unsigned int slots)
+{
+	struct futex_private_hash *old, *new;
+
+	lockdep_assert_held(&mm->futex_hash_lock);
+
+	old = rcu_dereference_protected(mm->futex_phash,
+					lockdep_is_held(&mm->futex_hash_lock));
+	if (old && old->hash_mask + 1 == slots)
+		return 0;
+
+	new = futex_private_hash_alloc(slots);
+	if (!new)
+		return -ENOMEM;
+
+	/*
+	 * The first hash is only installed while no other task can use the
+	 * mm, see futex_hash_set_slots(), so there is nothing to move over
+	 * from the global hash.
+	 */
+	if (!old) {
+		rcu_assign_pointer(mm->futex_phash, new);
+		return 0;
+	}
+
+	WRITE_ONCE(mm->futex_hash_migrating, true);
+	rcu_assign_pointer(mm->futex_phash, new);
+	synchronize_rcu();
+
+	futex_private_rehash(old, new);
+
+	WRITE_ONCE(mm->futex_hash_migrating, false);
+	smp_mb();
+	wake_up_var(&mm->futex_hash_migrating);
+
+	kvfree_rcu(old, rcu);
+	return 0;
+}
+
+/* Four buckets per thread that can run at the same time */
+static unsigned int futex_hash_auto_slots(unsigned int nr_threads)
+{
+	unsigned long slots;
+
+	slots = roundup_pow_of_two(4 * min(nr_threads, num_online_cpus()));
+	return clamp(slots, 16UL, futex_hashsize);
+}
+
+static int futex_hash_set_slots(unsigned int slots)
+{
+	struct mm_struct *mm = current->mm;
+	int ret;
+
+	if (slots && (slots < 2 || !is_power_of_2(slots) ||
+		      slots > futex_hashsize))
+		return -EINVAL;
+
+	mutex_lock(&mm->futex_hash_lock);
+	/*
+	 * Switching from the global hash would have to find this mm's
+	 * waiters among everybody else's. Avoid that by only allowing it
+	 * while nobody else can be waiting, i.e. before the first thread
+	 * is created.
+	 */
+	if (!rcu_access_pointer(mm->futex_phash) &&
+	    atomic_read(&mm->mm_users) != 1) {
+		ret = -EBUSY;
+		goto out_unlock;
+	}
+
+	mm->futex_hash_slots = slots;
+	if (!slots)
+		slots = futex_hash_auto_slots(get_nr_threads(current));
+	ret = futex_private_hash_set(mm, slots);
+out_unlock:
+	mutex_unlock(&mm->futex_hash_lock);
+	return ret;
+}
+
+static int futex_hash_get_slots(void)
+{
+	struct futex_private_hash *fph;
+	int ret = 0;
+
+	rcu_read_lock();
+	fph = rcu_dereference(current->mm->futex_phash);
+	if (fph)
+		ret = fph->hash_mask + 1;
+	rcu_read_unlock();
+	return ret;
+}
+
+int futex_hash_prctl(unsigned long arg2, unsigned long arg3)
+{
+	if (!current->mm)
+		return -EINVAL;
+
+	switch (arg2) {
+	case PR_FUTEX_HASH_SET_SLOTS:
+		if (arg3 > UINT_MAX)
+			return -EINVAL;
+		return futex_hash_set_slots(arg3);
+	case PR_FUTEX_HASH_GET_SLOTS:
+		if (arg3)
+			return -EINVAL;
+		return futex_hash_get_slots();
+	}
+	return -EINVAL;
+}
+
+/**
+ * futex_hash_grow - Grow an automatically sized private hash
+ * @mm:		The mm of the process which gains a thread
+ * @nr_threads:	The number of threads the process is going to have
+ *
+ * Called on thread creation. Failure to grow is not fatal, the waiters
+ * just share buckets more.
+ */
+void futex_hash_grow(struct mm_struct *mm, unsigned int nr_threads)
+{
+	unsigned int slots = futex_hash_auto_slots(nr_threads);
+	struct futex_private_hash *fph;
+	bool grow;
+
+	if (!mm || !rcu_access_pointer(mm->futex_phash) ||
+	    READ_ONCE(mm->futex_hash_slots))
+		return;
+
+	rcu_read_lock();
+	fph = rcu_dereference(mm->futex_phash);
+	grow = fph->hash_mask + 1 < slots;
+	rcu_read_unlock();
+	if (!grow)
+		return;
+
+	mutex_lock(&mm->futex_hash_lock);
+	fph = rcu_dereference_protected(mm->futex_phash,
+					lockdep_is_held(&mm->futex_hash_lock));
+	if (!mm->futex_hash_slots && fph->hash_mask + 1 < slots)
+		futex_private_hash_set(mm, slots);
+	mutex_unlock(&mm->futex_hash_lock);
+}
+
+void futex_mm_init(struct mm_struct *mm)
+{
+	mutex_init(&mm->futex_hash_lock);
+	RCU_INIT_POINTER(mm->futex_phash, NULL);
+	mm->futex_hash_slots = 0;
+	mm->futex_hash_migrating = false;
+}
+
+void futex_hash_free(struct mm_struct *mm)
+{
+	kvfree(rcu_dereference_raw(mm->futex_phash));
+}
+#endif /* CONFIG_FUTEX_PRIVATE_HASH */
+
 
 /**
  * futex_setup_timer - set up the sleeping hrtimer.
@@ -509,14 +833,10 @@ void __futex_unqueue(struct futex_q *q)
 	futex_hb_waiters_dec(hb);
 }
 
-/* The key must be already stored in q->key. */
-struct futex_hash_bucket *futex_q_lock(struct futex_q *q)
+static struct futex_hash_bucket *__futex_q_lock(struct futex_q *q,
+					       struct futex_hash_bucket *hb)
 	__acquires(&hb->lock)
 {
-	struct futex_hash_bucket *hb;
-
-	hb = futex_hash(&q->key);
-
 	/*
 	 * Increment the counter before taking the lock so that
 	 * a potential waker won't miss a to-be-slept task that is
@@ -533,11 +853,30 @@ struct futex_hash_bucket *futex_q_lock(struct futex_q *q)
 	return hb;
 }
 
+/* The key must be already stored in q->key. */
+struct futex_hash_bucket *futex_q_lock(struct futex_q *q)
+	__acquires(&hb->lock)
+{
+	/* Requeue PI waiters end up on a PI futex, keep them global */
+	if (q->requeue_pi_key)
+		return __futex_q_lock(q, futex_hash(&q->key));
+
+	return __futex_q_lock(q, futex_hash_get(&q->key, false));
+}
+
+/* Same as futex_q_lock(), but PI futexes always use the global hash. */
+struct futex_hash_bucket *futex_q_lock_pi(struct futex_q *q)
+	__acquires(&hb->lock)
+{
+	return __futex_q_lock(q, futex_hash(&q->key));
+}
+
 void futex_q_unlock(struct futex_hash_bucket *hb)
 	__releases(&hb->lock)
 {
 	spin_unlock(&hb->lock);
 	futex_hb_waiters_dec(hb);
+	futex_hash_put(hb);
 }
 
 void __futex_queue(struct futex_q *q, struct futex_hash_bucket *hb)
@@ -575,6 +914,12 @@ int futex_unqueue(struct futex_q *q)
 	spinlock_t *lock_ptr;
 	int ret = 0;
 
+	/*
+	 * The bucket q->lock_ptr points into may be freed by a resize of a
+	 * private hash, see futex_private_hash_set().
+	 */
+	rcu_read_lock();
+
 	/* In the common case we don't take the spinlock, which is nice. */
 retry:
 	/*
@@ -609,6 +954,7 @@ int futex_unqueue(struct futex_q *q)
 		spin_unlock(lock_ptr);
 		ret = 1;
 	}
+	rcu_read_unlock();
 
 	return ret;
 }
@@ -1138,11 +1484,8 @@ static int __init futex_init(void)
 					       futex_hashsize, futex_hashsize);
 	futex_hashsize = 1UL << futex_shift;
 
-	for (i = 0; i < futex_hashsize; i++) {
-		atomic_set(&futex_queues[i].waiters, 0);
-		plist_head_init(&futex_queues[i].chain);
-		spin_lock_init(&futex_queues[i].lock);
-	}
+	for (i = 0; i < futex_hashsize; i++)
+		futex_hash_bucket_init(&futex_queues[i], NULL);
 
 	return 0;
 }
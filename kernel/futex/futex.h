@@ -46,6 +46,9 @@ struct futex_hash_bucket {
 	atomic_t waiters;
 	spinlock_t lock;
 	struct plist_head chain;
+#ifdef CONFIG_FUTEX_PRIVATE_HASH
+	struct futex_private_hash *priv;
+#endif
 } ____cacheline_aligned_in_smp;
 
 /*
@@ -125,6 +128,36 @@ futex_setup_timer(ktime_t *time, struct hrtimer_sleeper *timeout,
 
 extern struct futex_hash_bucket *futex_hash(union futex_key *key);
 
+#ifdef CONFIG_FUTEX_PRIVATE_HASH
+extern struct futex_hash_bucket *futex_hash_get(union futex_key *key, bool wake);
+extern struct futex_hash_bucket *futex_hash_same(struct futex_hash_bucket *hb,
+						 union futex_key *key);
+
+/**
+ * futex_hash_put - Release a hash bucket returned by futex_hash_get()
+ * @hb:		The hash bucket, must no longer be locked by the caller
+ */
+static inline void futex_hash_put(struct futex_hash_bucket *hb)
+{
+	if (hb->priv)
+		rcu_read_unlock();
+}
+#else
+static inline struct futex_hash_bucket *
+futex_hash_get(union futex_key *key, bool wake)
+{
+	return futex_hash(key);
+}
+
+static inline struct futex_hash_bucket *
+futex_hash_same(struct futex_hash_bucket *hb, union futex_key *key)
+{
+	return futex_hash(key);
+}
+
+static inline void futex_hash_put(struct futex_hash_bucket *hb) { }
+#endif
+
 /**
  * futex_match - Check whether two futex keys are equal
  * @key1:	Pointer to key1
@@ -160,7 +193,8 @@ extern int futex_unqueue(struct futex_q *q);
  * @q:	The futex_q to enqueue
  * @hb:	The destination hash bucket
  *
- * The hb->lock must be held by the caller, and is released here. A call to
+ * The hb->lock must be held by the caller, and is released here along with
+ * the bucket itself, see futex_hash_put(). A call to
  * futex_queue() is typically paired with exactly one call to futex_unqueue().  The
  * exceptions involve the PI related operations, which may use futex_unqueue_pi()
  * or nothing if the unqueue is done as part of the wake process and the unqueue
@@ -172,6 +206,7 @@ static inline void futex_queue(struct futex_q *q, struct futex_hash_bucket *hb)
 {
 	__futex_queue(q, hb);
 	spin_unlock(&hb->lock);
+	futex_hash_put(hb);
 }
 
 extern void futex_unqueue_pi(struct futex_q *q);
@@ -217,6 +252,7 @@ static inline int futex_hb_waiters_pending(struct futex_hash_bucket *hb)
 }
 
 extern struct futex_hash_bucket *futex_q_lock(struct futex_q *q);
+extern struct futex_hash_bucket *futex_q_lock_pi(struct futex_q *q);
 extern void futex_q_unlock(struct futex_hash_bucket *hb);
 
 
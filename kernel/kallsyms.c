@@ -186,26 +186,84 @@ static bool cleanup_symbol_name(char *s)
 	return false;
 }
 
+/* Index in kallsyms_names of the symbol at @index in name order */
+static unsigned int get_symbol_seq(int index)
+{
+	unsigned int i, seq = 0;
+
+	for (i = 0; i < 3; i++)
+		seq = (seq << 8) | kallsyms_seqs_of_names[3 * index + i];
+
+	return seq;
+}
+
+/*
+ * Binary search kallsyms_seqs_of_names for @name. Returns the index in
+ * kallsyms_names of the first symbol in address order with that name, or
+ * -ENOENT.
+ */
+static int kallsyms_lookup_seq(const char *name)
+{
+	char namebuf[KSYM_NAME_LEN];
+	unsigned int low, mid, high;
+	unsigned int seq;
+
+	low = 0;
+	high = kallsyms_num_syms;
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		seq = get_symbol_seq(mid);
+		kallsyms_expand_symbol(get_symbol_offset(seq), namebuf,
+				       ARRAY_SIZE(namebuf));
+		if (strcmp(namebuf, name) < 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	if (low >= kallsyms_num_syms)
+		return -ENOENT;
+
+	seq = get_symbol_seq(low);
+	kallsyms_expand_symbol(get_symbol_offset(seq), namebuf,
+			       ARRAY_SIZE(namebuf));
+	if (strcmp(namebuf, name))
+		return -ENOENT;
+
+	return seq;
+}
+
 /* Lookup the address for this symbol. Returns 0 if not found. */
 unsigned long kallsyms_lookup_name(const char *name)
 {
 	char namebuf[KSYM_NAME_LEN];
 	unsigned long i;
 	unsigned int off;
+	int seq;
 
 	/* Skip the search for empty string. */
 	if (!*name)
 		return 0;
 
-	for (i = 0, off = 0; i < kallsyms_num_syms; i++) {
-		off = kallsyms_expand_symbol(off, namebuf, ARRAY_SIZE(namebuf));
+	seq = kallsyms_lookup_seq(name);
+	if (seq >= 0)
+		return kallsyms_sym_address(seq);
 
-		if (strcmp(namebuf, name) == 0)
-			return kallsyms_sym_address(i);
-
-		if (cleanup_symbol_name(namebuf) && strcmp(namebuf, name) == 0)
-			return kallsyms_sym_address(i);
+	/*
+	 * The table is sorted by the full names. Names which only match once
+	 * the LTO suffixes are stripped still need the linear scan.
+	 */
+	if (IS_ENABLED(CONFIG_LTO_CLANG)) {
+		for (i = 0, off = 0; i < kallsyms_num_syms; i++) {
+			off = kallsyms_expand_symbol(off, namebuf,
+						     ARRAY_SIZE(namebuf));
+
+			if (cleanup_symbol_name(namebuf) &&
+			    strcmp(namebuf, name) == 0)
+				return kallsyms_sym_address(i);
+		}
 	}
+
 	return module_kallsyms_lookup_name(name);
 }
 
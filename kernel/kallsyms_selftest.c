@@ -0,0 +1,234 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Test the correctness and the performance of kallsyms_lookup_name()
+ *
+ * Every symbol of vmlinux is looked up by name once, and the binary search
+ * through kallsyms_seqs_of_names is timed against the linear scan over all
+ * symbols which kallsyms_lookup_name() used to do.
+ */
+
+#define pr_fmt(fmt) "kallsyms_selftest: " fmt
+
+#include <linux/init.h>
+#include <linux/jhash.h>
+#include <linux/kallsyms.h>
+#include <linux/kernel.h>
+#include <linux/log2.h>
+#include <linux/module.h>
+#include <linux/sched/clock.h>
+#include <linux/string.h>
+#include <linux/vmalloc.h>
+
+#include "kallsyms_internal.h"
+
+struct test_item {
+	const char *name;
+	unsigned long addr;
+	bool data;
+};
+
+#define ITEM_FUNC(s)	{ .name = #s, .addr = (unsigned long)function_nocfi(s) }
+#define ITEM_DATA(s)	{ .name = #s, .addr = (unsigned long)&s, .data = true }
+
+int kallsyms_test_var_data = 1;
+
+static struct test_item test_items[] = {
+	ITEM_FUNC(kallsyms_lookup_name),
+	ITEM_FUNC(kallsyms_on_each_symbol),
+	ITEM_FUNC(sprint_symbol),
+	ITEM_FUNC(schedule),
+	ITEM_FUNC(msleep),
+	ITEM_DATA(kallsyms_test_var_data),
+};
+
+/* The address of the first symbol of a name, keyed by a hash of the name */
+struct first_sym {
+	u64 hash;
+	unsigned long addr;
+};
+
+struct test_stat {
+	char name[KSYM_NAME_LEN];
+	unsigned long addr;
+	unsigned long nr;
+	unsigned long failed;
+	struct first_sym *first;
+	unsigned int first_mask;
+};
+
+static int __init find_last(void *data, const char *name,
+			    struct module *mod, unsigned long addr)
+{
+	struct test_stat *stat = data;
+
+	strscpy(stat->name, name, sizeof(stat->name));
+	stat->addr = addr;
+	return 0;
+}
+
+static int __init find_linear(void *data, const char *name,
+			      struct module *mod, unsigned long addr)
+{
+	struct test_stat *stat = data;
+
+	if (strcmp(name, stat->name))
+		return 0;
+
+	stat->addr = addr;
+	return 1;
+}
+
+/*
+ * Returns the address of the first symbol named @name seen so far, and
+ * records @addr as that if there is none.
+ */
+static unsigned long __init first_addr(struct test_stat *stat,
+				       const char *name, unsigned long addr)
+{
+	u32 len = strlen(name);
+	u64 hash = (u64)jhash(name, len, 1) << 32 | jhash(name, len, 0);
+	unsigned int i;
+
+	/* 0 marks an unused slot */
+	if (!hash)
+		hash = 1;
+
+	for (i = hash & stat->first_mask; ; i = (i + 1) & stat->first_mask) {
+		struct first_sym *sym = &stat->first[i];
+
+		if (!sym->hash) {
+			sym->hash = hash;
+			sym->addr = addr;
+			return addr;
+		}
+		if (sym->hash == hash)
+			return sym->addr;
+	}
+}
+
+static int __init check_lookup(void *data, const char *name,
+			       struct module *mod, unsigned long addr)
+{
+	struct test_stat *stat = data;
+	unsigned long lookup_addr, expected;
+
+	if (!*name)
+		return 0;
+
+	/*
+	 * The symbols come in address order and the lookup returns the first
+	 * one of a name. Zero is a valid address, e.g. of the per-cpu symbols
+	 * on x86_64.
+	 */
+	stat->nr++;
+	expected = first_addr(stat, name, addr);
+	lookup_addr = kallsyms_lookup_name(name);
+	if (lookup_addr == expected)
+		return 0;
+
+	if (stat->failed++ < 10)
+		pr_err("%s: expected %lx, got %lx\n", name, expected, lookup_addr);
+
+	return 0;
+}
+
+static bool __init test_items_lookup(void)
+{
+	unsigned long addr;
+	bool ok = true;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(test_items); i++) {
+		/* Data symbols are only there with CONFIG_KALLSYMS_ALL */
+		if (test_items[i].data && !IS_ENABLED(CONFIG_KALLSYMS_ALL))
+			continue;
+
+		addr = kallsyms_lookup_name(test_items[i].name);
+		if (addr != test_items[i].addr) {
+			pr_err("%s: expected %lx, got %lx\n",
+			       test_items[i].name, test_items[i].addr, addr);
+			ok = false;
+		}
+	}
+
+	return ok;
+}
+
+static bool __init test_perf_lookup(void)
+{
+	static struct test_stat stat __initdata;
+	unsigned long addr, bsearch_addr;
+	bool ok = true;
+	u64 t0, t1, t2;
+
+	/* The last symbol in address order is the worst case of a scan */
+	kallsyms_on_each_symbol(find_last, &stat);
+	addr = stat.addr;
+
+	t0 = sched_clock();
+	bsearch_addr = kallsyms_lookup_name(stat.name);
+	t1 = sched_clock();
+	kallsyms_on_each_symbol(find_linear, &stat);
+	t2 = sched_clock();
+
+	pr_info("lookup of %s: binary search %llu ns, linear scan %llu ns\n",
+		stat.name, t1 - t0, t2 - t1);
+
+	if (bsearch_addr != addr) {
+		pr_err("%s: binary search expected %lx, got %lx\n",
+		       stat.name, addr, bsearch_addr);
+		ok = false;
+	}
+	if (stat.addr != addr) {
+		pr_err("%s: linear scan expected %lx, got %lx\n",
+		       stat.name, addr, stat.addr);
+		ok = false;
+	}
+
+	return ok;
+}
+
+static bool __init test_lookup_all(void)
+{
+	static struct test_stat stat __initdata;
+	unsigned int size;
+	u64 t0, t1;
+
+	/* Half full at most, to keep the probe sequences short */
+	size = roundup_pow_of_two(max(kallsyms_num_syms, 1U) * 2);
+	stat.first = vzalloc(array_size(size, sizeof(*stat.first)));
+	if (!stat.first) {
+		pr_err("failed to allocate the table of names\n");
+		return false;
+	}
+	stat.first_mask = size - 1;
+
+	t0 = sched_clock();
+	kallsyms_on_each_symbol(check_lookup, &stat);
+	t1 = sched_clock();
+
+	vfree(stat.first);
+
+	pr_info("looked up %lu symbols in %llu ns, %llu ns on average\n",
+		stat.nr, t1 - t0, stat.nr ? div_u64(t1 - t0, stat.nr) : 0);
+
+	if (stat.failed)
+		pr_err("%lu of %lu lookups failed\n", stat.failed, stat.nr);
+
+	return !stat.failed;
+}
+
+static int __init kallsyms_test_init(void)
+{
+	bool ok;
+
+	pr_info("start\n");
+
+	ok = test_items_lookup();
+	ok &= test_perf_lookup();
+	ok &= test_lookup_all();
+
+	pr_info("%s\n", ok ? "finish" : "failed");
+	return 0;
+}
+late_initcall(kallsyms_test_init);
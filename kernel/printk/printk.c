@@ -43,6 +43,9 @@
 #include <linux/poll.h>
 #include <linux/irq_work.h>
 #include <linux/ctype.h>
+#include <linux/debugfs.h>
+#include <linux/kthread.h>
+#include <linux/seq_file.h>
 #include <linux/uio.h>
 #include <linux/sched/clock.h>
 #include <linux/sched/debug.h>
@@ -280,6 +283,30 @@ static bool panic_in_progress(void)
  */
 static int console_locked, console_suspended;
 
+/*
+ * Once the per-console printing kthreads are running, printk() and
+ * console_unlock() leave the printing to them unless direct printing is
+ * required, see allow_direct_printing().
+ */
+static bool printk_kthreads_available;
+
+/*
+ * The printing kthreads are kept from printing while the console_lock is
+ * held. console_lock() blocks them one by one through @blocked of each
+ * console. console_trylock(), which can't sleep on the per-console lock,
+ * blocks them all at once by setting @console_kthreads_active, the number
+ * of kthreads currently printing, from 0 to -1.
+ */
+static atomic_t console_kthreads_active = ATOMIC_INIT(0);
+
+static bool allow_direct_printing(void)
+{
+	return !printk_kthreads_available ||
+	       system_state > SYSTEM_RUNNING ||
+	       oops_in_progress ||
+	       panic_in_progress();
+}
+
 /*
  *	Array of consoles built from command line options (console=)
  */
@@ -2251,8 +2278,11 @@ asmlinkage int vprintk_emit(int facility, int level,
 
 	printed_len = vprintk_store(facility, level, dev_info, fmt, args);
 
-	/* If called from the scheduler, we can not call up(). */
-	if (!in_sched) {
+	/*
+	 * If called from the scheduler, we can not call up(). The printing
+	 * kthreads are woken up through wake_up_klogd() below.
+	 */
+	if (!in_sched && allow_direct_printing()) {
 		/*
 		 * The caller may be holding system-critical or
 		 * timing-sensitive locks. Disable preemption during
@@ -2297,6 +2327,8 @@ asmlinkage __visible int _printk(const char *fmt, ...)
 EXPORT_SYMBOL(_printk);
 
 static bool __pr_flush(struct console *con, int timeout_ms, bool reset_on_progress);
+static void printk_start_kthread(struct console *con);
+static void printk_stop_kthread(struct console *con);
 
 #else /* CONFIG_PRINTK */
 
@@ -2331,6 +2363,8 @@ static void call_console_driver(struct console *con, const char *text, size_t le
 }
 static bool suppress_message_printing(int level) { return false; }
 static bool __pr_flush(struct console *con, int timeout_ms, bool reset_on_progress) { return true; }
+static void printk_start_kthread(struct console *con) { }
+static void printk_stop_kthread(struct console *con) { }
 
 #endif /* CONFIG_PRINTK */
 
@@ -2553,6 +2587,34 @@ static int console_cpu_notify(unsigned int cpu)
 	return 0;
 }
 
+/* Block the printing kthreads, see @console_kthreads_active. */
+static void console_kthreads_block(void)
+{
+	struct console *con;
+
+	for_each_console(con) {
+		mutex_lock(&con->lock);
+		con->blocked = true;
+		mutex_unlock(&con->lock);
+	}
+}
+
+static bool console_kthreads_atomic_tryblock(void)
+{
+	return atomic_cmpxchg(&console_kthreads_active, 0, -1) == 0;
+}
+
+static void console_kthreads_unblock(void)
+{
+	struct console *con;
+
+	for_each_console(con)
+		WRITE_ONCE(con->blocked, false);
+
+	if (atomic_read(&console_kthreads_active) == -1)
+		atomic_set(&console_kthreads_active, 0);
+}
+
 /**
  * console_lock - lock the console system for exclusive use.
  *
@@ -2568,6 +2630,7 @@ void console_lock(void)
 	down_console_sem();
 	if (console_suspended)
 		return;
+	console_kthreads_block();
 	console_locked = 1;
 	console_may_schedule = 1;
 }
@@ -2589,6 +2652,10 @@ int console_trylock(void)
 		up_console_sem();
 		return 0;
 	}
+	if (!console_kthreads_atomic_tryblock()) {
+		up_console_sem();
+		return 0;
+	}
 	console_locked = 1;
 	console_may_schedule = 0;
 	return 1;
@@ -2649,7 +2716,12 @@ static inline bool console_is_usable(struct console *con)
 static void __console_unlock(void)
 {
 	console_locked = 0;
+	console_kthreads_unblock();
 	up_console_sem();
+
+	/* The printing kthreads may have gone to sleep while blocked. */
+	if (printk_kthreads_available)
+		wake_up_klogd();
 }
 
 /*
@@ -2666,12 +2738,14 @@ static void __console_unlock(void)
  *
  * @handover will be set to true if a printk waiter has taken over the
  * console_lock, in which case the caller is no longer holding the
- * console_lock. Otherwise it is set to false.
+ * console_lock. Otherwise it is set to false. The printing kthreads pass
+ * a NULL @handover, they hold the lock of @con instead of the console_lock
+ * and have nothing to hand over.
  *
  * Returns false if the given console has no next record to print, otherwise
  * true.
  *
- * Requires the console_lock.
+ * Requires the console_lock or, for a NULL @handover, the lock of @con.
  */
 static bool console_emit_next_record(struct console *con, char *text, char *ext_text,
 				     char *dropped_text, bool *handover)
@@ -2685,7 +2759,8 @@ static bool console_emit_next_record(struct console *con, char *text, char *ext_
 
 	prb_rec_init_rd(&r, &info, text, CONSOLE_LOG_MAX);
 
-	*handover = false;
+	if (handover)
+		*handover = false;
 
 	if (!prb_read_valid(prb, con->seq, &r))
 		return false;
@@ -2726,7 +2801,8 @@ static bool console_emit_next_record(struct console *con, char *text, char *ext_
 	 * (@console_waiter is cleared).
 	 */
 	printk_safe_enter_irqsave(flags);
-	console_lock_spinning_enable();
+	if (handover)
+		console_lock_spinning_enable();
 
 	stop_critical_timings();	/* don't trace print latency */
 	call_console_driver(con, write_text, len, dropped_text);
@@ -2734,7 +2810,8 @@ static bool console_emit_next_record(struct console *con, char *text, char *ext_
 
 	con->seq++;
 
-	*handover = console_lock_spinning_disable_and_check();
+	if (handover)
+		*handover = console_lock_spinning_disable_and_check();
 	printk_safe_exit_irqrestore(flags);
 skip:
 	return true;
@@ -2842,6 +2919,12 @@ void console_unlock(void)
 		return;
 	}
 
+	/* Leave the printing to the kthreads unless it's urgent. */
+	if (!allow_direct_printing()) {
+		__console_unlock();
+		return;
+	}
+
 	/*
 	 * Console drivers are called with interrupts disabled, so
 	 * @console_may_schedule should be cleared before; however, we may
@@ -2908,6 +2991,10 @@ void console_unblank(void)
 	if (oops_in_progress) {
 		if (down_trylock_console_sem() != 0)
 			return;
+		if (!console_kthreads_atomic_tryblock()) {
+			up_console_sem();
+			return;
+		}
 	} else
 		console_lock();
 
@@ -3190,6 +3277,10 @@ void register_console(struct console *newcon)
 		nr_ext_console_drivers++;
 
 	newcon->dropped = 0;
+	newcon->thread = NULL;
+	newcon->blocked = true;
+	mutex_init(&newcon->lock);
+
 	if (newcon->flags & CON_PRINTBUFFER) {
 		/* Get a consistent copy of @syslog_seq. */
 		mutex_lock(&syslog_lock);
@@ -3199,6 +3290,14 @@ void register_console(struct console *newcon)
 		/* Begin with next message. */
 		newcon->seq = prb_next_seq(prb);
 	}
+
+	/*
+	 * Under console_lock, like printk_activate_kthreads(), so that only
+	 * one of the two starts the kthread.
+	 */
+	if (printk_kthreads_available)
+		printk_start_kthread(newcon);
+
 	console_unlock();
 	console_sysfs_notify();
 
@@ -3268,6 +3367,8 @@ int unregister_console(struct console *console)
 	console_unlock();
 	console_sysfs_notify();
 
+	printk_stop_kthread(console);
+
 	if (console->exit)
 		res = console->exit(console);
 
@@ -3362,6 +3463,212 @@ static int __init printk_late_init(void)
 late_initcall(printk_late_init);
 
 #if defined CONFIG_PRINTK
+/*
+ * Per-console printing kthreads. Each one reads the ringbuffer at the
+ * sequence number of its console, so a slow console only holds back its
+ * own kthread, and printk() callers no longer print in their context.
+ */
+static bool printer_should_wake(struct console *con, u64 seq)
+{
+	short flags;
+
+	if (kthread_should_stop())
+		return true;
+
+	if (READ_ONCE(con->blocked) ||
+	    atomic_read(&console_kthreads_active) == -1)
+		return false;
+
+	/*
+	 * This is an unsafe read of con->flags, but a false positive is not
+	 * a problem. Worst case it would allow the printer to wake up even
+	 * when it is disabled. But the printer will notice that itself when
+	 * attempting to print.
+	 */
+	flags = data_race(READ_ONCE(con->flags));
+	if (!(flags & CON_ENABLED))
+		return false;
+
+	return prb_read_valid(prb, seq, NULL);
+}
+
+static bool console_kthread_printing_tryenter(struct console *con)
+{
+	mutex_lock(&con->lock);
+	if (con->blocked ||
+	    !atomic_inc_unless_negative(&console_kthreads_active)) {
+		mutex_unlock(&con->lock);
+		return false;
+	}
+
+	return true;
+}
+
+static void console_kthread_printing_exit(struct console *con)
+{
+	atomic_dec(&console_kthreads_active);
+	mutex_unlock(&con->lock);
+}
+
+/*
+ * The buffers of a printing kthread. They are allocated before the kthread
+ * is started and freed after it is stopped, so that the kthread itself
+ * cannot fail and exit while @con->thread still points to it.
+ */
+struct printk_kthread_data {
+	struct console	*con;
+	char		*text;
+	char		*ext_text;
+	char		*dropped_text;
+};
+
+static void printk_kthread_data_free(struct printk_kthread_data *d)
+{
+	kfree(d->dropped_text);
+	kfree(d->ext_text);
+	kfree(d->text);
+	kfree(d);
+}
+
+static int printk_kthread_func(void *data)
+{
+	struct printk_kthread_data *d = data;
+	struct console *con = d->con;
+	bool progress;
+	u64 seq;
+
+	con_printk(KERN_INFO, con, "printing thread started\n");
+
+	seq = data_race(READ_ONCE(con->seq));
+
+	for (;;) {
+		wait_event_interruptible(log_wait, printer_should_wake(con, seq));
+
+		if (kthread_should_stop())
+			break;
+
+		do {
+			if (!console_kthread_printing_tryenter(con))
+				break;
+
+			progress = false;
+			if (console_is_usable(con))
+				progress = console_emit_next_record(con, d->text, d->ext_text,
+								    d->dropped_text, NULL);
+			seq = con->seq;
+
+			console_kthread_printing_exit(con);
+
+			cond_resched();
+		} while (progress && !kthread_should_stop());
+	}
+
+	con_printk(KERN_INFO, con, "printing thread stopped\n");
+
+	return 0;
+}
+
+/* Must be called under console_lock. */
+static void printk_start_kthread(struct console *con)
+{
+	struct printk_kthread_data *d;
+	struct task_struct *thread;
+
+	if (con->thread)
+		return;
+
+	d = kzalloc(sizeof(*d), GFP_KERNEL);
+	if (!d)
+		goto fail;
+
+	d->con = con;
+	d->text = kmalloc(CONSOLE_LOG_MAX, GFP_KERNEL);
+	if (con->flags & CON_EXTENDED)
+		d->ext_text = kmalloc(CONSOLE_EXT_LOG_MAX, GFP_KERNEL);
+	else
+		d->dropped_text = kmalloc(DROPPED_TEXT_MAX, GFP_KERNEL);
+
+	if (!d->text || (!d->ext_text && !d->dropped_text)) {
+		printk_kthread_data_free(d);
+		goto fail;
+	}
+
+	thread = kthread_run(printk_kthread_func, d, "pr/%s%d",
+			     con->name, con->index);
+	if (IS_ERR(thread)) {
+		con_printk(KERN_ERR, con, "unable to start printing thread\n");
+		printk_kthread_data_free(d);
+		goto fallback;
+	}
+
+	con->thread = thread;
+	return;
+
+fail:
+	con_printk(KERN_ERR, con, "failed to allocate printing thread buffers\n");
+fallback:
+	/* Fall back to printing in the printk() caller's context. */
+	printk_kthreads_available = false;
+	defer_console_output();
+}
+
+static void printk_stop_kthread(struct console *con)
+{
+	struct printk_kthread_data *d;
+
+	if (!con->thread)
+		return;
+
+	/* the kthread may never have run printk_kthread_func() at all */
+	d = kthread_data(con->thread);
+	kthread_stop(con->thread);
+	con->thread = NULL;
+	printk_kthread_data_free(d);
+}
+
+/* The number of records @con has yet to print. */
+static u64 console_lag(struct console *con)
+{
+	u64 next_seq = prb_next_seq(prb);
+
+	return next_seq > con->seq ? next_seq - con->seq : 0;
+}
+
+static int printk_consoles_show(struct seq_file *m, void *v)
+{
+	struct console *con;
+
+	seq_puts(m, "# console seq lag dropped thread\n");
+
+	console_lock();
+	for_each_console(con) {
+		seq_printf(m, "%s%d %llu %llu %lu %d\n", con->name, con->index,
+			   con->seq, console_lag(con), con->dropped,
+			   con->thread ? task_pid_nr(con->thread) : 0);
+	}
+	console_unlock();
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(printk_consoles);
+
+static int __init printk_activate_kthreads(void)
+{
+	struct console *con;
+
+	console_lock();
+	printk_kthreads_available = true;
+	for_each_console(con)
+		printk_start_kthread(con);
+	console_unlock();
+
+	debugfs_create_file("printk_consoles", 0444, NULL, NULL,
+			    &printk_consoles_fops);
+
+	return 0;
+}
+late_initcall(printk_activate_kthreads);
+
 /* If @con is specified, only wait for that console. Otherwise wait for all. */
 static bool __pr_flush(struct console *con, int timeout_ms, bool reset_on_progress)
 {
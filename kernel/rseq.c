@@ -9,6 +9,7 @@
  */
 
 #include <linux/sched.h>
+#include <linux/sched/mm.h>
 #include <linux/uaccess.h>
 #include <linux/syscalls.h>
 #include <linux/rseq.h>
@@ -85,12 +86,15 @@
 static int rseq_update_cpu_id(struct task_struct *t)
 {
 	u32 cpu_id = raw_smp_processor_id();
+	u32 node_id = cpu_to_node(cpu_id);
 	struct rseq __user *rseq = t->rseq;
 
 	if (!user_write_access_begin(rseq, sizeof(*rseq)))
 		goto efault;
 	unsafe_put_user(cpu_id, &rseq->cpu_id_start, efault_end);
 	unsafe_put_user(cpu_id, &rseq->cpu_id, efault_end);
+	unsafe_put_user(node_id, &rseq->node_id, efault_end);
+	unsafe_put_user((u32)task_mm_cid(t), &rseq->mm_cid, efault_end);
 	user_write_access_end();
 	trace_rseq_update(t);
 	return 0;
@@ -103,7 +107,8 @@ static int rseq_update_cpu_id(struct task_struct *t)
 
 static int rseq_reset_rseq_cpu_id(struct task_struct *t)
 {
-	u32 cpu_id_start = 0, cpu_id = RSEQ_CPU_ID_UNINITIALIZED;
+	u32 cpu_id_start = 0, cpu_id = RSEQ_CPU_ID_UNINITIALIZED, node_id = 0,
+	    mm_cid = 0;
 
 	/*
 	 * Reset cpu_id_start to its initial state (0).
@@ -117,6 +122,13 @@ static int rseq_reset_rseq_cpu_id(struct task_struct *t)
 	 */
 	if (put_user(cpu_id, &t->rseq->cpu_id))
 		return -EFAULT;
+	/*
+	 * Reset node_id and mm_cid to their initial state (0).
+	 */
+	if (put_user(node_id, &t->rseq->node_id))
+		return -EFAULT;
+	if (put_user(mm_cid, &t->rseq->mm_cid))
+		return -EFAULT;
 	return 0;
 }
 
@@ -344,14 +356,16 @@ SYSCALL_DEFINE4(rseq, struct rseq __user *, rseq, u32, rseq_len,
 		/* Unregister rseq for current thread. */
 		if (current->rseq != rseq || !current->rseq)
 			return -EINVAL;
-		if (rseq_len != sizeof(*rseq))
+		if (rseq_len != current->rseq_len)
 			return -EINVAL;
 		if (current->rseq_sig != sig)
 			return -EPERM;
 		ret = rseq_reset_rseq_cpu_id(current);
 		if (ret)
 			return ret;
+		sched_mm_cid_deactivate(current);
 		current->rseq = NULL;
+		current->rseq_len = 0;
 		current->rseq_sig = 0;
 		return 0;
 	}
@@ -365,7 +379,7 @@ SYSCALL_DEFINE4(rseq, struct rseq __user *, rseq, u32, rseq_len,
 		 * the provided address differs from the prior
 		 * one.
 		 */
-		if (current->rseq != rseq || rseq_len != sizeof(*rseq))
+		if (current->rseq != rseq || rseq_len != current->rseq_len)
 			return -EINVAL;
 		if (current->rseq_sig != sig)
 			return -EPERM;
@@ -375,15 +389,21 @@ SYSCALL_DEFINE4(rseq, struct rseq __user *, rseq, u32, rseq_len,
 
 	/*
 	 * If there was no rseq previously registered,
-	 * ensure the provided rseq is properly aligned and valid.
+	 * ensure the provided rseq is properly aligned, as advertised
+	 * by AT_RSEQ_ALIGN, and valid: at least the original 32 bytes,
+	 * which cover the AT_RSEQ_FEATURE_SIZE fields the kernel
+	 * updates, and at most a page.
 	 */
+	BUILD_BUG_ON(offsetof(struct rseq, end) > ORIG_RSEQ_SIZE);
 	if (!IS_ALIGNED((unsigned long)rseq, __alignof__(*rseq)) ||
-	    rseq_len != sizeof(*rseq))
+	    rseq_len < ORIG_RSEQ_SIZE || rseq_len > PAGE_SIZE)
 		return -EINVAL;
 	if (!access_ok(rseq, rseq_len))
 		return -EFAULT;
 	current->rseq = rseq;
+	current->rseq_len = rseq_len;
 	current->rseq_sig = sig;
+	sched_mm_cid_activate(current);
 	/*
 	 * If rseq was previously inactive, and has just been
 	 * registered, ensure the cpu_id_start and cpu_id fields
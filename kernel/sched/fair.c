@@ -588,6 +588,98 @@ static inline bool entity_before(struct sched_entity *a,
 #define __node_2_se(node) \
 	rb_entry((node), struct sched_entity, run_node)
 
+static inline s64 entity_key(struct cfs_rq *cfs_rq, struct sched_entity *se)
+{
+	return (s64)(se->vruntime - cfs_rq->min_vruntime);
+}
+
+/*
+ * The zero-lag point V of a cfs_rq is the weighted average of the vruntime
+ * of its entities:
+ *
+ *   V = \Sum v_i * w_i / \Sum w_i
+ *
+ * Entities with v_i <= V are owed service and thereby eligible. To keep
+ * the sum small it is kept relative to min_vruntime:
+ *
+ *   \Sum (v_i - v0) * w_i = avg_vruntime,  \Sum w_i = avg_load
+ *
+ * which needs fixing up whenever min_vruntime moves. Only entities in the
+ * timeline are accounted, cfs_rq->curr is added on the fly.
+ */
+static void
+avg_vruntime_add(struct cfs_rq *cfs_rq, struct sched_entity *se)
+{
+	unsigned long weight = scale_load_down(se->load.weight);
+	s64 key = entity_key(cfs_rq, se);
+
+	cfs_rq->avg_vruntime += key * weight;
+	cfs_rq->avg_load += weight;
+}
+
+static void
+avg_vruntime_sub(struct cfs_rq *cfs_rq, struct sched_entity *se)
+{
+	unsigned long weight = scale_load_down(se->load.weight);
+	s64 key = entity_key(cfs_rq, se);
+
+	cfs_rq->avg_vruntime -= key * weight;
+	cfs_rq->avg_load -= weight;
+}
+
+static inline
+void avg_vruntime_update(struct cfs_rq *cfs_rq, s64 delta)
+{
+	/*
+	 * v' = v + d ==> avg_vruntime' = avg_runtime - d*avg_load
+	 */
+	cfs_rq->avg_vruntime -= cfs_rq->avg_load * delta;
+}
+
+static u64 avg_vruntime(struct cfs_rq *cfs_rq)
+{
+	struct sched_entity *curr = cfs_rq->curr;
+	s64 avg = cfs_rq->avg_vruntime;
+	long load = cfs_rq->avg_load;
+
+	if (curr && curr->on_rq) {
+		unsigned long weight = scale_load_down(curr->load.weight);
+
+		avg += entity_key(cfs_rq, curr) * weight;
+		load += weight;
+	}
+
+	if (load) {
+		/* sign flips effective floor / ceil */
+		if (avg < 0)
+			avg -= (load - 1);
+		avg = div_s64(avg, load);
+	}
+
+	return cfs_rq->min_vruntime + avg;
+}
+
+/*
+ * Entity is eligible once it received less service than it ought to have,
+ * i.e. lag >= 0, i.e. v_i <= V. Compare without the division of
+ * avg_vruntime() to avoid losing precision.
+ */
+static int entity_eligible(struct cfs_rq *cfs_rq, struct sched_entity *se)
+{
+	struct sched_entity *curr = cfs_rq->curr;
+	s64 avg = cfs_rq->avg_vruntime;
+	long load = cfs_rq->avg_load;
+
+	if (curr && curr->on_rq) {
+		unsigned long weight = scale_load_down(curr->load.weight);
+
+		avg += entity_key(cfs_rq, curr) * weight;
+		load += weight;
+	}
+
+	return avg >= entity_key(cfs_rq, se) * load;
+}
+
 static void update_min_vruntime(struct cfs_rq *cfs_rq)
 {
 	struct sched_entity *curr = cfs_rq->curr;
@@ -612,8 +704,9 @@ static void update_min_vruntime(struct cfs_rq *cfs_rq)
 	}
 
 	/* ensure we never gain time by being placed backwards. */
-	u64_u32_store(cfs_rq->min_vruntime,
-		      max_vruntime(cfs_rq->min_vruntime, vruntime));
+	vruntime = max_vruntime(cfs_rq->min_vruntime, vruntime);
+	avg_vruntime_update(cfs_rq, (s64)(vruntime - cfs_rq->min_vruntime));
+	u64_u32_store(cfs_rq->min_vruntime, vruntime);
 }
 
 static inline bool __entity_less(struct rb_node *a, const struct rb_node *b)
@@ -621,17 +714,52 @@ static inline bool __entity_less(struct rb_node *a, const struct rb_node *b)
 	return entity_before(__node_2_se(a), __node_2_se(b));
 }
 
+#define deadline_gt(field, lse, rse) ({ (s64)((lse)->field - (rse)->field) > 0; })
+
+static inline void __update_min_deadline(struct sched_entity *se, struct rb_node *node)
+{
+	if (node) {
+		struct sched_entity *rse = __node_2_se(node);
+
+		if (deadline_gt(min_deadline, se, rse))
+			se->min_deadline = rse->min_deadline;
+	}
+}
+
+/*
+ * se->min_deadline = min(se->deadline, left->min_deadline, right->min_deadline)
+ */
+static inline bool min_deadline_update(struct sched_entity *se, bool exit)
+{
+	u64 old_min_deadline = se->min_deadline;
+	struct rb_node *node = &se->run_node;
+
+	se->min_deadline = se->deadline;
+	__update_min_deadline(se, node->rb_right);
+	__update_min_deadline(se, node->rb_left);
+
+	return se->min_deadline == old_min_deadline;
+}
+
+RB_DECLARE_CALLBACKS(static, min_deadline_cb, struct sched_entity,
+		     run_node, min_deadline, min_deadline_update);
+
 /*
  * Enqueue an entity into the rb-tree:
  */
 static void __enqueue_entity(struct cfs_rq *cfs_rq, struct sched_entity *se)
 {
-	rb_add_cached(&se->run_node, &cfs_rq->tasks_timeline, __entity_less);
+	avg_vruntime_add(cfs_rq, se);
+	se->min_deadline = se->deadline;
+	rb_add_augmented_cached(&se->run_node, &cfs_rq->tasks_timeline,
+				__entity_less, &min_deadline_cb);
 }
 
 static void __dequeue_entity(struct cfs_rq *cfs_rq, struct sched_entity *se)
 {
-	rb_erase_cached(&se->run_node, &cfs_rq->tasks_timeline);
+	rb_erase_augmented_cached(&se->run_node, &cfs_rq->tasks_timeline,
+				  &min_deadline_cb);
+	avg_vruntime_sub(cfs_rq, se);
 }
 
 struct sched_entity *__pick_first_entity(struct cfs_rq *cfs_rq)
@@ -654,6 +782,128 @@ static struct sched_entity *__pick_next_entity(struct sched_entity *se)
 	return __node_2_se(next);
 }
 
+/*
+ * Earliest Eligible Virtual Deadline First
+ *
+ * In order to provide latency guarantees for different request sizes
+ * EEVDF selects the best runnable task from two criteria:
+ *
+ *  1) the task must be eligible (must be owed service)
+ *
+ *  2) from those tasks that meet 1), we select the one
+ *     with the earliest virtual deadline.
+ *
+ * We can do this in O(log n) time due to an augmented RB-tree. The
+ * tree keeps the entries sorted on vruntime, but also functions as a
+ * heap based on the deadline by keeping:
+ *
+ *  se->min_deadline = min(se->deadline, se->{left,right}->min_deadline)
+ *
+ * Which allows an EDF like search on (sub)trees.
+ */
+static struct sched_entity *__pick_eevdf(struct cfs_rq *cfs_rq)
+{
+	struct rb_node *node = cfs_rq->tasks_timeline.rb_root.rb_node;
+	struct sched_entity *curr = cfs_rq->curr;
+	struct sched_entity *best_left = NULL;
+	struct sched_entity *best;
+
+	if (curr && (!curr->on_rq || !entity_eligible(cfs_rq, curr)))
+		curr = NULL;
+	best = curr;
+
+	while (node) {
+		struct sched_entity *se = __node_2_se(node);
+
+		/*
+		 * If this entity is not eligible, try the left subtree.
+		 */
+		if (!entity_eligible(cfs_rq, se)) {
+			node = node->rb_left;
+			continue;
+		}
+
+		/*
+		 * Now we heap search eligible trees for the best (min_)deadline
+		 */
+		if (!best || deadline_gt(deadline, best, se))
+			best = se;
+
+		/*
+		 * Every se in a left branch is eligible, keep track of the
+		 * branch with the best min_deadline
+		 */
+		if (node->rb_left) {
+			struct sched_entity *left = __node_2_se(node->rb_left);
+
+			if (!best_left || deadline_gt(min_deadline, best_left, left))
+				best_left = left;
+
+			/*
+			 * min_deadline is in the left branch. rb_left and all
+			 * descendants are eligible, so immediately switch to the
+			 * second loop.
+			 */
+			if (left->min_deadline == se->min_deadline)
+				break;
+		}
+
+		/* min_deadline is at this node, no need to look right */
+		if (se->deadline == se->min_deadline)
+			break;
+
+		/* else min_deadline is in the right branch. */
+		node = node->rb_right;
+	}
+
+	/*
+	 * We ran into an eligible node which is itself the best.
+	 * (Or nr_running == 0 and both are NULL)
+	 */
+	if (!best_left || (s64)(best_left->min_deadline - best->deadline) > 0)
+		return best;
+
+	/*
+	 * Now best_left and all of its children are eligible, and we are just
+	 * looking for deadline == min_deadline
+	 */
+	node = &best_left->run_node;
+	while (node) {
+		struct sched_entity *se = __node_2_se(node);
+
+		/* min_deadline is the current node */
+		if (se->deadline == se->min_deadline)
+			return se;
+
+		/* min_deadline is in the left branch */
+		if (node->rb_left &&
+		    __node_2_se(node->rb_left)->min_deadline == se->min_deadline) {
+			node = node->rb_left;
+			continue;
+		}
+
+		/* else min_deadline is in the right branch */
+		node = node->rb_right;
+	}
+	return NULL;
+}
+
+static struct sched_entity *pick_eevdf(struct cfs_rq *cfs_rq)
+{
+	struct sched_entity *se = __pick_eevdf(cfs_rq);
+
+	if (!se) {
+		struct sched_entity *left = __pick_first_entity(cfs_rq);
+
+		if (left) {
+			printk_deferred_once(KERN_ERR "EEVDF scheduling fail, picking leftmost\n");
+			return left;
+		}
+	}
+
+	return se;
+}
+
 #ifdef CONFIG_SCHED_DEBUG
 struct sched_entity *__pick_last_entity(struct cfs_rq *cfs_rq)
 {
@@ -879,6 +1129,44 @@ static void update_tg_load_avg(struct cfs_rq *cfs_rq)
 }
 #endif /* CONFIG_SMP */
 
+/*
+ * Remember the lag of @se across a sleep, bounded so that neither a long
+ * running nor a long starved entity carries an unreasonable amount.
+ */
+static void update_entity_lag(struct cfs_rq *cfs_rq, struct sched_entity *se)
+{
+	s64 lag, limit;
+
+	lag = avg_vruntime(cfs_rq) - se->vruntime;
+	limit = calc_delta_fair(max_t(u64, 2*se->slice, TICK_NSEC), se);
+	se->vlag = clamp(lag, -limit, limit);
+}
+
+static void clear_buddies(struct cfs_rq *cfs_rq, struct sched_entity *se);
+
+/*
+ * XXX: strictly: vd_i += N*r_i/w_i such that: vd_i > ve_i
+ * this is probably good enough.
+ */
+static void update_deadline(struct cfs_rq *cfs_rq, struct sched_entity *se)
+{
+	if ((s64)(se->vruntime - se->deadline) < 0)
+		return;
+
+	/*
+	 * EEVDF: vd_i = ve_i + r_i / w_i
+	 */
+	se->deadline = se->vruntime + calc_delta_fair(se->slice, se);
+
+	/*
+	 * The task has consumed its request, reschedule.
+	 */
+	if (sched_feat(EEVDF) && cfs_rq->nr_running > 1) {
+		resched_curr(rq_of(cfs_rq));
+		clear_buddies(cfs_rq, se);
+	}
+}
+
 /*
  * Update the current task's runtime statistics.
  */
@@ -909,6 +1197,8 @@ static void update_curr(struct cfs_rq *cfs_rq)
 	schedstat_add(cfs_rq->exec_clock, delta_exec);
 
 	curr->vruntime += calc_delta_fair(delta_exec, curr);
+	if (curr->on_rq)
+		update_deadline(cfs_rq, curr);
 	update_min_vruntime(cfs_rq);
 
 	if (entity_is_task(curr)) {
@@ -1079,6 +1369,23 @@ adjust_numa_imbalance(int imbalance, int dst_running, int imb_numa_nr)
 }
 #endif /* CONFIG_NUMA */
 
+static inline bool is_core_idle(int cpu)
+{
+#ifdef CONFIG_SCHED_SMT
+	int sibling;
+
+	for_each_cpu(sibling, cpu_smt_mask(cpu)) {
+		if (cpu == sibling)
+			continue;
+
+		if (!idle_cpu(sibling))
+			return false;
+	}
+#endif
+
+	return true;
+}
+
 #ifdef CONFIG_NUMA_BALANCING
 /*
  * Approximate time to scan a full NUMA task in ms. The task scan period is
@@ -1536,23 +1843,6 @@ struct numa_stats {
 	int idle_cpu;
 };
 
-static inline bool is_core_idle(int cpu)
-{
-#ifdef CONFIG_SCHED_SMT
-	int sibling;
-
-	for_each_cpu(sibling, cpu_smt_mask(cpu)) {
-		if (cpu == sibling)
-			continue;
-
-		if (!idle_cpu(sibling))
-			return false;
-	}
-#endif
-
-	return true;
-}
-
 struct task_numa_env {
 	struct task_struct *p;
 
@@ -3145,6 +3435,8 @@ static void reweight_entity(struct cfs_rq *cfs_rq, struct sched_entity *se,
 		/* commit outstanding execution time */
 		if (cfs_rq->curr == se)
 			update_curr(cfs_rq);
+		else
+			avg_vruntime_sub(cfs_rq, se);
 		update_load_sub(&cfs_rq->load, se->load.weight);
 	}
 	dequeue_load_avg(cfs_rq, se);
@@ -3160,9 +3452,11 @@ static void reweight_entity(struct cfs_rq *cfs_rq, struct sched_entity *se,
 #endif
 
 	enqueue_load_avg(cfs_rq, se);
-	if (se->on_rq)
+	if (se->on_rq) {
 		update_load_add(&cfs_rq->load, se->load.weight);
-
+		if (cfs_rq->curr != se)
+			avg_vruntime_add(cfs_rq, se);
+	}
 }
 
 void reweight_task(struct task_struct *p, int prio)
@@ -4463,11 +4757,57 @@ static void check_spread(struct cfs_rq *cfs_rq, struct sched_entity *se)
 #endif
 }
 
+/*
+ * EEVDF placement: put @se at the zero-lag point, minus the lag it had
+ * when it went to sleep. Adding an entity with lag moves the zero-lag
+ * point itself, by vl_i * w_i / (W + w_i), so inflate the lag up front
+ * such that @se really ends up with the lag it left with.
+ */
+static void
+place_entity_eevdf(struct cfs_rq *cfs_rq, struct sched_entity *se, int initial)
+{
+	u64 vslice = calc_delta_fair(se->slice, se);
+	struct sched_entity *curr = cfs_rq->curr;
+	s64 lag = 0;
+	long load;
+
+	load = cfs_rq->avg_load;
+	if (curr && curr->on_rq)
+		load += scale_load_down(curr->load.weight);
+
+	if (!initial && load) {
+		lag = se->vlag;
+		lag *= load + scale_load_down(se->load.weight);
+		lag = div_s64(lag, load);
+	}
+
+	se->vruntime = avg_vruntime(cfs_rq) - lag;
+
+	/*
+	 * When joining the competition; the existing tasks will be,
+	 * on average, halfway through their slice, as such start tasks
+	 * off with half a slice to ease into the competition.
+	 */
+	if (initial && sched_feat(START_DEBIT))
+		vslice /= 2;
+
+	/* Relative until __enqueue_entity(), see enqueue_entity(). */
+	se->deadline = vslice;
+}
+
 static void
 place_entity(struct cfs_rq *cfs_rq, struct sched_entity *se, int initial)
 {
 	u64 vruntime = cfs_rq->min_vruntime;
 
+	if (sched_feat(EEVDF)) {
+		place_entity_eevdf(cfs_rq, se, initial);
+		return;
+	}
+
+	/* A fresh request, relative until enqueued. */
+	se->deadline = calc_delta_fair(se->slice, se);
+
 	/*
 	 * The 'current' period is already promised to the current tasks,
 	 * however the extra weight of the new task will slow them down a
@@ -4574,6 +4914,12 @@ enqueue_entity(struct cfs_rq *cfs_rq, struct sched_entity *se, int flags)
 	if (flags & ENQUEUE_WAKEUP)
 		place_entity(cfs_rq, se, 0);
 
+	/*
+	 * While not queued the deadline holds what is left of the request,
+	 * make it absolute again now that the vruntime is settled.
+	 */
+	se->deadline += se->vruntime;
+
 	check_schedstat_required();
 	update_stats_enqueue_fair(cfs_rq, se, flags);
 	check_spread(cfs_rq, se);
@@ -4658,11 +5004,16 @@ dequeue_entity(struct cfs_rq *cfs_rq, struct sched_entity *se, int flags)
 
 	clear_buddies(cfs_rq, se);
 
+	if (sched_feat(EEVDF))
+		update_entity_lag(cfs_rq, se);
 	if (se != cfs_rq->curr)
 		__dequeue_entity(cfs_rq, se);
 	se->on_rq = 0;
 	account_entity_dequeue(cfs_rq, se);
 
+	/* Keep the remaining request, see enqueue_entity(). */
+	se->deadline -= se->vruntime;
+
 	/*
 	 * Normalize after update_curr(); which will also have moved
 	 * min_vruntime if @se is the one holding it back. But before doing
@@ -4700,6 +5051,10 @@ check_preempt_tick(struct cfs_rq *cfs_rq, struct sched_entity *curr)
 	struct sched_entity *se;
 	s64 delta;
 
+	/* EEVDF preempts on request completion, see update_deadline(). */
+	if (sched_feat(EEVDF))
+		return;
+
 	ideal_runtime = sched_slice(cfs_rq, curr);
 	delta_exec = curr->sum_exec_runtime - curr->prev_sum_exec_runtime;
 	if (delta_exec > ideal_runtime) {
@@ -4784,6 +5139,10 @@ pick_next_entity(struct cfs_rq *cfs_rq, struct sched_entity *curr)
 	struct sched_entity *left = __pick_first_entity(cfs_rq);
 	struct sched_entity *se;
 
+	/* The deadline picker needs neither the skip nor the other buddies. */
+	if (sched_feat(EEVDF))
+		return pick_eevdf(cfs_rq);
+
 	/*
 	 * If curr is set we have to see if its left of the leftmost entity
 	 * still in the tree, provided there was anything in the tree at all.
@@ -6507,6 +6866,91 @@ static inline int select_idle_smt(struct task_struct *p, struct sched_domain *sd
 
 #endif /* CONFIG_SCHED_SMT */
 
+/*
+ * sd_llc_shared keeps a mask of the LLC's idle CPUs and one of its idle
+ * cores, so that select_idle_cpu() can go straight to a candidate instead of
+ * scanning the domain. Only the CPU itself updates its bits: it sets them when
+ * it switches to the idle task and clears them when it switches away. A core
+ * is recorded by whichever of its siblings went idle last, and any sibling
+ * leaving idle clears the whole core. Readers must verify what they find.
+ */
+void __update_idle_cpumask(int cpu, bool idle)
+{
+	struct sched_domain_shared *sds;
+	const struct cpumask *smt;
+	struct cpumask *cpus, *cores;
+	int sibling;
+
+	rcu_read_lock();
+	sds = rcu_dereference(per_cpu(sd_llc_shared, cpu));
+	if (!sds)
+		goto unlock;
+
+	cpus = sds_idle_cpus(sds);
+	cores = sds_idle_cores(sds);
+
+	/* Avoid dirtying the shared line when there is nothing to change. */
+	if (idle) {
+		if (!cpumask_test_cpu(cpu, cpus))
+			cpumask_set_cpu(cpu, cpus);
+		if (is_core_idle(cpu) && !cpumask_test_cpu(cpu, cores))
+			cpumask_set_cpu(cpu, cores);
+		goto unlock;
+	}
+
+	if (cpumask_test_cpu(cpu, cpus))
+		cpumask_clear_cpu(cpu, cpus);
+
+#ifdef CONFIG_SCHED_SMT
+	smt = cpu_smt_mask(cpu);
+#else
+	smt = cpumask_of(cpu);
+#endif
+	for_each_cpu(sibling, smt) {
+		if (cpumask_test_cpu(sibling, cores))
+			cpumask_clear_cpu(sibling, cores);
+	}
+unlock:
+	rcu_read_unlock();
+}
+
+/*
+ * The SIS_IDLE_MASK flavour of select_idle_cpu(): rather than scanning the
+ * LLC, only look at the CPUs its idle masks point at, starting after @target.
+ */
+static int select_idle_mask(struct task_struct *p, struct sched_domain *sd,
+			    struct sched_domain_shared *sds, bool has_idle_core,
+			    int target)
+{
+	struct cpumask *cpus = this_cpu_cpumask_var_ptr(select_rq_mask);
+	int cpu;
+
+	cpumask_and(cpus, sched_domain_span(sd), p->cpus_ptr);
+
+	if (has_idle_core) {
+		for_each_cpu_wrap(cpu, sds_idle_cores(sds), target + 1) {
+			if (cpumask_test_cpu(cpu, cpus) &&
+			    available_idle_cpu(cpu) && is_core_idle(cpu) &&
+			    sched_cpu_cookie_match(cpu_rq(cpu), p))
+				goto hit;
+		}
+		set_idle_cores(target, false);
+	}
+
+	for_each_cpu_wrap(cpu, sds_idle_cpus(sds), target + 1) {
+		if (cpumask_test_cpu(cpu, cpus) && available_idle_cpu(cpu) &&
+		    sched_cpu_cookie_match(cpu_rq(cpu), p))
+			goto hit;
+	}
+
+	schedstat_inc(sd->sis_mask_miss);
+	return -1;
+
+hit:
+	schedstat_inc(sd->sis_mask_hit);
+	return cpu;
+}
+
 /*
  * Scan the LLC domain for idle CPUs; this is dynamically regulated by
  * comparing the average scan cost (tracked in sd->avg_scan_cost) against the
@@ -6526,6 +6970,12 @@ static int select_idle_cpu(struct task_struct *p, struct sched_domain *sd, bool
 	if (!this_sd)
 		return -1;
 
+	if (sched_feat(SIS_IDLE_MASK)) {
+		sd_share = rcu_dereference(per_cpu(sd_llc_shared, target));
+		if (sd_share)
+			return select_idle_mask(p, sd, sd_share, has_idle_core, target);
+	}
+
 	cpumask_and(cpus, sched_domain_span(sd), p->cpus_ptr);
 
 	if (sched_feat(SIS_PROP) && !has_idle_core) {
@@ -7306,6 +7756,56 @@ balance_fair(struct rq *rq, struct task_struct *prev, struct rq_flags *rf)
 }
 #endif /* CONFIG_SMP */
 
+/*
+ * Latency nice maps linearly onto [-sysctl_sched_latency,
+ * sysctl_sched_latency): the offset is how much earlier (negative) or
+ * later (positive) than its vruntime says an entity may preempt at
+ * wakeup. It leaves the weight, hence the CPU share, alone.
+ */
+static long calc_latency_offset(int prio)
+{
+	s64 offset = (s64)sysctl_sched_latency * LATENCY_TO_NICE(prio);
+
+	return (long)div_s64(offset, LATENCY_NICE_WIDTH / 2);
+}
+
+/*
+ * For EEVDF the virtual time slope is determined by the weight (iow.
+ * nice) while the request size is determined by latency nice: a smaller
+ * request gets an earlier deadline, hence a better latency.
+ */
+static u64 calc_latency_slice(int prio)
+{
+	u64 base = sysctl_sched_min_granularity;
+
+	return div_u64(base << SCHED_FIXEDPOINT_SHIFT, sched_prio_to_weight[prio]);
+}
+
+void set_latency_offset(struct task_struct *p)
+{
+	p->se.latency_offset = calc_latency_offset(p->latency_prio);
+	p->se.slice = calc_latency_slice(p->latency_prio);
+}
+
+static long wakeup_latency_gran(struct sched_entity *curr,
+				struct sched_entity *se)
+{
+	long latency_offset = READ_ONCE(se->latency_offset);
+	long curr_offset = READ_ONCE(curr->latency_offset);
+
+	/*
+	 * A negative latency offset means that the sched_entity has latency
+	 * requirement that needs to be evaluated versus other entity.
+	 * Otherwise, use the latency offset to evaluate how much scheduling
+	 * delay is acceptable by se.
+	 */
+	if (latency_offset < 0 || curr_offset < 0)
+		latency_offset -= curr_offset;
+
+	return clamp_t(long, latency_offset, -(long)sysctl_sched_latency,
+		       sysctl_sched_latency);
+}
+
 static unsigned long wakeup_gran(struct sched_entity *se)
 {
 	unsigned long gran = sysctl_sched_wakeup_granularity;
@@ -7345,6 +7845,9 @@ wakeup_preempt_entity(struct sched_entity *curr, struct sched_entity *se)
 {
 	s64 gran, vdiff = curr->vruntime - se->vruntime;
 
+	/* Take into account latency offset */
+	vdiff -= wakeup_latency_gran(curr, se);
+
 	if (vdiff <= 0)
 		return -1;
 
@@ -7453,6 +7956,12 @@ static void check_preempt_wakeup(struct rq *rq, struct task_struct *p, int wake_
 		return;
 
 	update_curr(cfs_rq_of(se));
+	if (sched_feat(EEVDF)) {
+		/* Preempt if the wakee is now the best eligible entity. */
+		if (pick_eevdf(cfs_rq_of(se)) == pse)
+			goto preempt;
+		return;
+	}
 	if (wakeup_preempt_entity(se, pse) == 1) {
 		/*
 		 * Bias pick_next to pick the sched entity that is
@@ -7712,6 +8221,12 @@ static void yield_task_fair(struct rq *rq)
 		rq_clock_skip_update(rq);
 	}
 
+	/* Yielding with EEVDF means giving up the rest of the request. */
+	if (sched_feat(EEVDF)) {
+		se->deadline += calc_delta_fair(se->slice, se);
+		return;
+	}
+
 	set_skip_buddy(se);
 }
 
@@ -8037,6 +8552,49 @@ static inline int migrate_degrades_locality(struct task_struct *p,
 }
 #endif
 
+/*
+ * Rough cost, in ns, of what p leaves behind when pulled from src_cpu to
+ * dst_cpu: the migration cost scaled by how busy the task is, by the node
+ * distance, and doubled again if most of its memory faults come from the
+ * node it is leaving.
+ */
+static u64 newidle_footprint(struct task_struct *p, struct lb_env *env)
+{
+	int src_nid = cpu_to_node(env->src_cpu);
+	int dst_nid = cpu_to_node(env->dst_cpu);
+	u64 cost;
+
+	cost = (u64)sysctl_sched_migration_cost * (task_util(p) + 1);
+	cost >>= SCHED_CAPACITY_SHIFT;
+
+	if (src_nid == dst_nid)
+		return cost;
+
+	cost = div_u64(cost * node_distance(src_nid, dst_nid), LOCAL_DISTANCE);
+
+#ifdef CONFIG_NUMA_BALANCING
+	if (static_branch_likely(&sched_numa_balancing) && p->numa_faults &&
+	    task_faults(p, src_nid) > task_faults(p, dst_nid))
+		cost *= 2;
+#endif
+
+	return cost;
+}
+
+/*
+ * With NEWIDLE_BUDGET, a newly idle CPU only pulls across nodes what it can
+ * pay for out of the idle time it expects to have left after the scan; see
+ * newidle_balance().
+ */
+static inline bool newidle_too_expensive(struct task_struct *p, struct lb_env *env)
+{
+	if (env->idle != CPU_NEWLY_IDLE || !(env->sd->flags & SD_NUMA) ||
+	    !sched_feat(NEWIDLE_BUDGET))
+		return false;
+
+	return newidle_footprint(p, env) > env->dst_rq->newidle_budget;
+}
+
 /*
  * can_migrate_task - may task p from runqueue rq be migrated to this_cpu?
  */
@@ -8112,6 +8670,12 @@ int can_migrate_task(struct task_struct *p, struct lb_env *env)
 	if (env->flags & LBF_ACTIVE_LB)
 		return 1;
 
+	if (newidle_too_expensive(p, env)) {
+		schedstat_inc(env->sd->nib_expensive);
+		schedstat_inc(p->stats.nr_failed_migrations_hot);
+		return 0;
+	}
+
 	tsk_cache_hot = migrate_degrades_locality(p, env);
 	if (tsk_cache_hot == -1)
 		tsk_cache_hot = task_hot(p, env);
@@ -11331,6 +11895,20 @@ static int newidle_balance(struct rq *this_rq, struct rq_flags *rf)
 		if (this_rq->avg_idle < curr_cost + sd->max_newidle_lb_cost)
 			break;
 
+		/*
+		 * What is left of the expected idle time once this level has
+		 * been scanned. Going across nodes is only worth it if that
+		 * covers at least the cache refill of the cheapest pull; the
+		 * tasks themselves are weighed in can_migrate_task().
+		 */
+		this_rq->newidle_budget = this_rq->avg_idle - curr_cost -
+					  sd->max_newidle_lb_cost;
+		if (sched_feat(NEWIDLE_BUDGET) && (sd->flags & SD_NUMA) &&
+		    this_rq->newidle_budget < sysctl_sched_migration_cost) {
+			schedstat_inc(sd->nib_skipped);
+			break;
+		}
+
 		if (sd->flags & SD_BALANCE_NEWIDLE) {
 
 			pulled_task = load_balance(this_cpu, this_rq,
@@ -11340,6 +11918,7 @@ static int newidle_balance(struct rq *this_rq, struct rq_flags *rf)
 			t1 = sched_clock_cpu(this_cpu);
 			domain_cost = t1 - t0;
 			update_newidle_cost(sd, domain_cost);
+			schedstat_add(sd->nib_cost, domain_cost);
 
 			curr_cost += domain_cost;
 			t0 = t1;
@@ -11891,6 +12470,7 @@ int alloc_fair_sched_group(struct task_group *tg, struct task_group *parent)
 		goto err;
 
 	tg->shares = NICE_0_LOAD;
+	tg->latency_prio = DEFAULT_LATENCY_PRIO;
 
 	init_cfs_bandwidth(tg_cfs_bandwidth(tg));
 
@@ -11992,6 +12572,8 @@ void init_tg_cfs_entry(struct task_group *tg, struct cfs_rq *cfs_rq,
 	/* guarantee group entities always have weight */
 	update_load_set(&se->load, NICE_0_LOAD);
 	se->parent = parent;
+	se->latency_offset = calc_latency_offset(tg->latency_prio);
+	se->slice = calc_latency_slice(tg->latency_prio);
 }
 
 static DEFINE_MUTEX(shares_mutex);
@@ -12119,6 +12701,37 @@ int sched_group_set_idle(struct task_group *tg, long idle)
 	return 0;
 }
 
+int sched_group_set_latency(struct task_group *tg, int prio)
+{
+	long latency_offset;
+	u64 slice;
+	int i;
+
+	if (tg == &root_task_group)
+		return -EINVAL;
+
+	mutex_lock(&shares_mutex);
+
+	if (tg->latency_prio == prio) {
+		mutex_unlock(&shares_mutex);
+		return 0;
+	}
+
+	tg->latency_prio = prio;
+	latency_offset = calc_latency_offset(prio);
+	slice = calc_latency_slice(prio);
+
+	for_each_possible_cpu(i) {
+		struct sched_entity *se = tg->se[i];
+
+		WRITE_ONCE(se->latency_offset, latency_offset);
+		WRITE_ONCE(se->slice, slice);
+	}
+
+	mutex_unlock(&shares_mutex);
+	return 0;
+}
+
 #else /* CONFIG_FAIR_GROUP_SCHED */
 
 void free_fair_sched_group(struct task_group *tg) { }
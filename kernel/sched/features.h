@@ -12,6 +12,14 @@ SCHED_FEAT(GENTLE_FAIR_SLEEPERS, true)
  */
 SCHED_FEAT(START_DEBIT, true)
 
+/*
+ * Pick the eligible entity with the earliest virtual deadline (EEVDF)
+ * instead of the leftmost one plus buddies, place waking entities by
+ * their lag and preempt on request completion rather than on the
+ * wakeup granularity.
+ */
+SCHED_FEAT(EEVDF, false)
+
 /*
  * Prefer to schedule the task we woke last (assuming it failed
  * wakeup-preemption), since its likely going to consume data we
@@ -63,6 +71,20 @@ SCHED_FEAT(TTWU_QUEUE, true)
 SCHED_FEAT(SIS_PROP, false)
 SCHED_FEAT(SIS_UTIL, true)
 
+/*
+ * Have select_idle_cpu() only look at the CPUs the LLC's idle masks claim
+ * are idle, instead of scanning the domain. CPUs that are merely running
+ * SCHED_IDLE tasks are not in the masks and are only found as target/prev.
+ */
+SCHED_FEAT(SIS_IDLE_MASK, true)
+
+/*
+ * Budget newidle balancing across NUMA levels against the expected idle
+ * time: skip levels that can't pay for a pull and don't pull tasks whose
+ * cache and memory footprint costs more than the idle time left.
+ */
+SCHED_FEAT(NEWIDLE_BUDGET, true)
+
 /*
  * Issue a WARN when we do multiple update_rq_clock() calls
  * in a single rq->lock section. Default disabled because the
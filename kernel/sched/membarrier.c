@@ -306,11 +306,19 @@ static int membarrier_global_expedited(void)
 	return 0;
 }
 
-static int membarrier_private_expedited(int flags, int cpu_id)
+/*
+ * Expedited barrier on the CPUs running threads of the caller's mm. With
+ * @cpu_id < 0 all online CPUs are considered. Otherwise only @cpu_id is
+ * targeted if @cpu_bits is 0, or the CPUs @cpu_id + n for each bit n set in
+ * @cpu_bits.
+ */
+static int membarrier_private_expedited(int flags, int cpu_id,
+					unsigned long cpu_bits)
 {
 	cpumask_var_t tmpmask;
 	struct mm_struct *mm = current->mm;
 	smp_call_func_t ipi_func = ipi_mb;
+	bool single = cpu_id >= 0 && !cpu_bits;
 
 	if (flags == MEMBARRIER_FLAG_SYNC_CORE) {
 		if (!IS_ENABLED(CONFIG_ARCH_HAS_MEMBARRIER_SYNC_CORE))
@@ -343,12 +351,12 @@ static int membarrier_private_expedited(int flags, int cpu_id)
 	 */
 	smp_mb();	/* system call entry is not a mb. */
 
-	if (cpu_id < 0 && !zalloc_cpumask_var(&tmpmask, GFP_KERNEL))
+	if (!single && !zalloc_cpumask_var(&tmpmask, GFP_KERNEL))
 		return -ENOMEM;
 
 	cpus_read_lock();
 
-	if (cpu_id >= 0) {
+	if (single) {
 		struct task_struct *p;
 
 		if (cpu_id >= nr_cpu_ids || !cpu_online(cpu_id))
@@ -360,6 +368,24 @@ static int membarrier_private_expedited(int flags, int cpu_id)
 			goto out;
 		}
 		rcu_read_unlock();
+	} else if (cpu_bits) {
+		unsigned int bit;
+
+		/* Only look at the selected CPUs, not at all online ones */
+		rcu_read_lock();
+		for_each_set_bit(bit, &cpu_bits, MEMBARRIER_CMD_FLAG_CPU_MASK_BITS) {
+			unsigned int cpu = cpu_id + bit;
+			struct task_struct *p;
+
+			if (cpu >= nr_cpu_ids)
+				break;
+			if (!cpu_online(cpu))
+				continue;
+			p = rcu_dereference(cpu_rq(cpu)->curr);
+			if (p && p->mm == mm)
+				__cpumask_set_cpu(cpu, tmpmask);
+		}
+		rcu_read_unlock();
 	} else {
 		int cpu;
 
@@ -374,7 +400,7 @@ static int membarrier_private_expedited(int flags, int cpu_id)
 		rcu_read_unlock();
 	}
 
-	if (cpu_id >= 0) {
+	if (single) {
 		/*
 		 * smp_call_function_single() will call ipi_func() if cpu_id
 		 * is the calling CPU.
@@ -408,7 +434,7 @@ static int membarrier_private_expedited(int flags, int cpu_id)
 	}
 
 out:
-	if (cpu_id < 0)
+	if (!single)
 		free_cpumask_var(tmpmask);
 	cpus_read_unlock();
 
@@ -547,10 +573,13 @@ static int membarrier_register_private_expedited(int flags)
  *          MEMBARRIER_CMD_PRIVATE_EXPEDITED_RSEQ: in the latter
  *          case it can be MEMBARRIER_CMD_FLAG_CPU, indicating that @cpu_id
  *          contains the CPU on which to interrupt (= restart)
- *          the RSEQ critical section.
+ *          the RSEQ critical section, or MEMBARRIER_CMD_FLAG_CPU_MASK
+ *          together with a mask of CPUs relative to @cpu_id in its
+ *          upper bits.
  * @cpu_id: if @flags == MEMBARRIER_CMD_FLAG_CPU, indicates the cpu on which
  *          RSEQ CS should be interrupted (@cmd must be
- *          MEMBARRIER_CMD_PRIVATE_EXPEDITED_RSEQ).
+ *          MEMBARRIER_CMD_PRIVATE_EXPEDITED_RSEQ). With
+ *          MEMBARRIER_CMD_FLAG_CPU_MASK, the first cpu of the mask.
  *
  * If this system call is not implemented, -ENOSYS is returned. If the
  * command specified does not exist, not available on the running
@@ -578,8 +607,18 @@ static int membarrier_register_private_expedited(int flags)
  */
 SYSCALL_DEFINE3(membarrier, int, cmd, unsigned int, flags, int, cpu_id)
 {
+	unsigned long cpu_bits = 0;
+
 	switch (cmd) {
 	case MEMBARRIER_CMD_PRIVATE_EXPEDITED_RSEQ:
+		if (flags & MEMBARRIER_CMD_FLAG_CPU_MASK) {
+			cpu_bits = flags >> MEMBARRIER_CMD_FLAG_CPU_MASK_SHIFT;
+			flags &= ~(~0U << MEMBARRIER_CMD_FLAG_CPU_MASK_SHIFT);
+			if (unlikely(flags != MEMBARRIER_CMD_FLAG_CPU_MASK ||
+				     !cpu_bits || cpu_id < 0))
+				return -EINVAL;
+			break;
+		}
 		if (unlikely(flags && flags != MEMBARRIER_CMD_FLAG_CPU))
 			return -EINVAL;
 		break;
@@ -588,7 +627,7 @@ SYSCALL_DEFINE3(membarrier, int, cmd, unsigned int, flags, int, cpu_id)
 			return -EINVAL;
 	}
 
-	if (!(flags & MEMBARRIER_CMD_FLAG_CPU))
+	if (!(flags & (MEMBARRIER_CMD_FLAG_CPU | MEMBARRIER_CMD_FLAG_CPU_MASK)))
 		cpu_id = -1;
 
 	switch (cmd) {
@@ -612,15 +651,16 @@ SYSCALL_DEFINE3(membarrier, int, cmd, unsigned int, flags, int, cpu_id)
 	case MEMBARRIER_CMD_REGISTER_GLOBAL_EXPEDITED:
 		return membarrier_register_global_expedited();
 	case MEMBARRIER_CMD_PRIVATE_EXPEDITED:
-		return membarrier_private_expedited(0, cpu_id);
+		return membarrier_private_expedited(0, cpu_id, 0);
 	case MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED:
 		return membarrier_register_private_expedited(0);
 	case MEMBARRIER_CMD_PRIVATE_EXPEDITED_SYNC_CORE:
-		return membarrier_private_expedited(MEMBARRIER_FLAG_SYNC_CORE, cpu_id);
+		return membarrier_private_expedited(MEMBARRIER_FLAG_SYNC_CORE, cpu_id, 0);
 	case MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED_SYNC_CORE:
 		return membarrier_register_private_expedited(MEMBARRIER_FLAG_SYNC_CORE);
 	case MEMBARRIER_CMD_PRIVATE_EXPEDITED_RSEQ:
-		return membarrier_private_expedited(MEMBARRIER_FLAG_RSEQ, cpu_id);
+		return membarrier_private_expedited(MEMBARRIER_FLAG_RSEQ, cpu_id,
+						    cpu_bits);
 	case MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED_RSEQ:
 		return membarrier_register_private_expedited(MEMBARRIER_FLAG_RSEQ);
 	default:
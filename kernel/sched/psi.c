@@ -135,6 +135,10 @@
  * This gives us an approximation of pressure that is practical
  * cost-wise, yet way more sensitive and accurate than periodic
  * sampling of the aggregate task states would be.
+ *
+ * A CPU on which a group is idle contributes nothing to the sums, so
+ * each group keeps a mask of the CPUs that may have time to report
+ * and the aggregators only visit those.
  */
 
 static int psi_bug __read_mostly;
@@ -160,7 +164,7 @@ __setup("psi=", setup_psi);
 #define EXP_300s	2034		/* 1/exp(2s/300s) */
 
 /* PSI trigger definitions */
-#define WINDOW_MIN_US 500000	/* Min window size is 500ms */
+#define WINDOW_MIN_US 50000	/* Min window size is 50ms */
 #define WINDOW_MAX_US 10000000	/* Max window size is 10s */
 #define UPDATES_PER_WINDOW 10	/* 10 updates per window */
 
@@ -175,11 +179,43 @@ struct psi_group psi_system = {
 
 static void psi_avgs_work(struct work_struct *work);
 
+/*
+ * All groups with triggers are polled by a single "psimon" kthread that
+ * sleeps until the earliest polling deadline among them. The scheduler
+ * hot path can't wake it directly, so a group with new stall activity is
+ * queued on psi_poll_kicked and the one psi_poll_timer is armed instead.
+ */
+static DEFINE_MUTEX(psi_poll_mutex);
+static LIST_HEAD(psi_poll_groups);	/* groups in polling mode */
+static LLIST_HEAD(psi_poll_kicked);	/* groups with new stall activity */
+static struct task_struct *psi_poll_task;
+static unsigned int psi_poll_users;	/* triggers across all groups */
+static DECLARE_WAIT_QUEUE_HEAD(psi_poll_wait);
+static atomic_t psi_poll_wakeup;
+
 static void poll_timer_fn(struct timer_list *t);
+static DEFINE_TIMER(psi_poll_timer, poll_timer_fn);
 
-static void group_init(struct psi_group *group)
+static void group_free_masks(struct psi_group *group)
 {
-	int cpu;
+	int a;
+
+	for (a = 0; a < NR_PSI_AGGREGATORS; a++)
+		free_cpumask_var(group->active_cpus[a]);
+}
+
+static int group_init(struct psi_group *group)
+{
+	int cpu, a;
+
+	for (a = 0; a < NR_PSI_AGGREGATORS; a++) {
+		if (!alloc_cpumask_var(&group->active_cpus[a], GFP_KERNEL)) {
+			group_free_masks(group);
+			return -ENOMEM;
+		}
+		/* The first pass of each aggregator weeds out the idle CPUs */
+		cpumask_copy(group->active_cpus[a], cpu_possible_mask);
+	}
 
 	for_each_possible_cpu(cpu)
 		seqcount_init(&per_cpu_ptr(group->pcpu, cpu)->seq);
@@ -192,9 +228,10 @@ static void group_init(struct psi_group *group)
 	INIT_LIST_HEAD(&group->triggers);
 	group->poll_min_period = U32_MAX;
 	group->polling_next_update = ULLONG_MAX;
-	init_waitqueue_head(&group->poll_wait);
-	timer_setup(&group->poll_timer, poll_timer_fn, 0);
-	rcu_assign_pointer(group->poll_task, NULL);
+	INIT_LIST_HEAD(&group->poll_node);
+	atomic_set(&group->poll_scheduled, 0);
+
+	return 0;
 }
 
 void __init psi_init(void)
@@ -208,7 +245,8 @@ void __init psi_init(void)
 		static_branch_disable(&psi_cgroups_enabled);
 
 	psi_period = jiffies_to_nsecs(PSI_FREQ);
-	group_init(&psi_system);
+	if (group_init(&psi_system))
+		static_branch_enable(&psi_disabled);
 }
 
 static bool test_state(unsigned int *tasks, enum psi_states state)
@@ -235,7 +273,7 @@ static bool test_state(unsigned int *tasks, enum psi_states state)
 	}
 }
 
-static void get_recent_times(struct psi_group *group, int cpu,
+static u32 get_recent_times(struct psi_group *group, int cpu,
 			     enum psi_aggregators aggregator, u32 *times,
 			     u32 *pchanged_states)
 {
@@ -278,6 +316,8 @@ static void get_recent_times(struct psi_group *group, int cpu,
 		if (delta)
 			*pchanged_states |= (1 << s);
 	}
+
+	return state_mask;
 }
 
 static void calc_avgs(unsigned long avg[3], int missed_periods,
@@ -304,6 +344,7 @@ static void collect_percpu_times(struct psi_group *group,
 				 enum psi_aggregators aggregator,
 				 u32 *pchanged_states)
 {
+	struct cpumask *mask = group->active_cpus[aggregator];
 	u64 deltas[NR_PSI_STATES - 1] = { 0, };
 	unsigned long nonidle_total = 0;
 	u32 changed_states = 0;
@@ -317,16 +358,33 @@ static void collect_percpu_times(struct psi_group *group,
 	 * For averaging, each CPU is weighted by its non-idle time in
 	 * the sampling period. This eliminates artifacts from uneven
 	 * loading, or even entirely idle CPUs.
+	 *
+	 * CPUs on which the group has been idle since our last visit
+	 * have nothing to add and are skipped altogether.
 	 */
-	for_each_possible_cpu(cpu) {
+	for_each_cpu(cpu, mask) {
 		u32 times[NR_PSI_STATES];
 		u32 nonidle;
 		u32 cpu_changed_states;
+		u32 state_mask;
 
-		get_recent_times(group, cpu, aggregator, times,
-				&cpu_changed_states);
+		state_mask = get_recent_times(group, cpu, aggregator, times,
+					      &cpu_changed_states);
 		changed_states |= cpu_changed_states;
 
+		/*
+		 * Drop a CPU that went idle, but re-check after clearing
+		 * its bit: psi_group_change() only sets it when the state
+		 * leaves idle, and it may have done so after our snapshot
+		 * while still seeing the bit set.
+		 */
+		if (!state_mask) {
+			cpumask_clear_cpu(cpu, mask);
+			smp_mb__after_atomic();
+			if (READ_ONCE(per_cpu_ptr(group->pcpu, cpu)->state_mask))
+				cpumask_set_cpu(cpu, mask);
+		}
+
 		nonidle = nsecs_to_jiffies(times[PSI_NONIDLE]);
 		nonidle_total += nonidle;
 
@@ -505,6 +563,7 @@ static u64 update_triggers(struct psi_group *group, u64 now)
 {
 	struct psi_trigger *t;
 	bool update_total = false;
+	bool pending = false;
 	u64 *total = group->total[PSI_POLL];
 
 	/*
@@ -545,8 +604,10 @@ static u64 update_triggers(struct psi_group *group, u64 now)
 			}
 		}
 		/* Limit event signaling to once per window */
-		if (now < t->last_event_time + t->win.size)
+		if (now < t->last_event_time + t->win.size) {
+			pending = true;
 			continue;
+		}
 
 		/* Generate an event */
 		if (cmpxchg(&t->event, 0, 1) == 0)
@@ -559,45 +620,65 @@ static u64 update_triggers(struct psi_group *group, u64 now)
 	if (update_total)
 		memcpy(group->polling_total, total,
 				sizeof(group->polling_total));
+	group->poll_pending = pending;
 
 	return now + group->poll_min_period;
 }
 
-/* Schedule polling if it's not already scheduled. */
-static void psi_schedule_poll_work(struct psi_group *group, unsigned long delay)
+/*
+ * Hand @group to the poll worker if it isn't queued already. Called from
+ * the scheduler hot path, hence the detour through psi_poll_timer.
+ */
+static void psi_schedule_poll_work(struct psi_group *group)
 {
-	struct task_struct *task;
-
-	/*
-	 * Do not reschedule if already scheduled.
-	 * Possible race with a timer scheduled after this check but before
-	 * mod_timer below can be tolerated because group->polling_next_update
-	 * will keep updates on schedule.
-	 */
-	if (timer_pending(&group->poll_timer))
+	if (atomic_read(&group->poll_scheduled) ||
+	    atomic_xchg(&group->poll_scheduled, 1))
 		return;
 
-	rcu_read_lock();
+	llist_add(&group->poll_kick, &psi_poll_kicked);
 
-	task = rcu_dereference(group->poll_task);
 	/*
-	 * kworker might be NULL in case psi_trigger_destroy races with
-	 * psi_task_change (hotpath) which can't use locks
+	 * Racing with a timer armed after this check is fine, the worker
+	 * takes everything that is queued by the time it runs.
 	 */
-	if (likely(task))
-		mod_timer(&group->poll_timer, jiffies + delay);
+	if (!timer_pending(&psi_poll_timer))
+		mod_timer(&psi_poll_timer, jiffies + 1);
+}
 
-	rcu_read_unlock();
+/* Move the kicked groups onto psi_poll_groups, due right away. */
+static void psi_poll_drain(u64 now)
+{
+	struct psi_group *group, *tmp;
+	struct llist_node *kicked;
+
+	lockdep_assert_held(&psi_poll_mutex);
+
+	kicked = llist_del_all(&psi_poll_kicked);
+	llist_for_each_entry_safe(group, tmp, kicked, poll_kick) {
+		if (list_empty(&group->poll_node)) {
+			group->polling_next_update = now;
+			list_add_tail(&group->poll_node, &psi_poll_groups);
+		}
+	}
 }
 
-static void psi_poll_work(struct psi_group *group)
+/*
+ * Poll @group and return when it wants to be looked at next, or
+ * ULLONG_MAX once it has left polling mode.
+ */
+static u64 psi_poll_group(struct psi_group *group, u64 now)
 {
 	u32 changed_states;
-	u64 now;
+	u64 next;
 
 	mutex_lock(&group->trigger_lock);
 
-	now = sched_clock();
+	/*
+	 * Activity from here on kicks the group again. Pairs with the
+	 * hot path reading poll_scheduled after updating the state.
+	 */
+	atomic_set(&group->poll_scheduled, 0);
+	smp_mb__after_atomic();
 
 	collect_percpu_times(group, PSI_POLL, &changed_states);
 
@@ -620,40 +701,78 @@ static void psi_poll_work(struct psi_group *group)
 		goto out;
 	}
 
-	if (now >= group->polling_next_update)
-		group->polling_next_update = update_triggers(group, now);
-
-	psi_schedule_poll_work(group,
-		nsecs_to_jiffies(group->polling_next_update - now) + 1);
+	/*
+	 * Only walk the triggers if there is new stall time since they
+	 * last looked, or an event that is still being ratelimited.
+	 */
+	if (now >= group->polling_next_update) {
+		if (group->poll_pending ||
+		    memcmp(group->polling_total, group->total[PSI_POLL],
+			   sizeof(group->polling_total)))
+			group->polling_next_update = update_triggers(group, now);
+		else
+			group->polling_next_update = now + group->poll_min_period;
+	}
 
 out:
+	next = group->polling_next_update;
 	mutex_unlock(&group->trigger_lock);
+
+	return next;
 }
 
-static int psi_poll_worker(void *data)
+static u64 psi_poll_work(void)
 {
-	struct psi_group *group = (struct psi_group *)data;
+	struct psi_group *group, *tmp;
+	u64 now, due, next = ULLONG_MAX;
 
+	mutex_lock(&psi_poll_mutex);
+
+	now = sched_clock();
+	psi_poll_drain(now);
+
+	list_for_each_entry_safe(group, tmp, &psi_poll_groups, poll_node) {
+		due = group->polling_next_update;
+		if (now >= due) {
+			due = psi_poll_group(group, now);
+			if (due == ULLONG_MAX) {
+				list_del_init(&group->poll_node);
+				continue;
+			}
+		}
+		next = min(next, due);
+	}
+
+	mutex_unlock(&psi_poll_mutex);
+
+	return next;
+}
+
+static int psi_poll_worker(void *data)
+{
 	sched_set_fifo_low(current);
 
-	while (true) {
-		wait_event_interruptible(group->poll_wait,
-				atomic_cmpxchg(&group->poll_wakeup, 1, 0) ||
-				kthread_should_stop());
-		if (kthread_should_stop())
-			break;
+	while (!kthread_should_stop()) {
+		long timeout = MAX_SCHEDULE_TIMEOUT;
+		u64 next, now;
+
+		next = psi_poll_work();
+		if (next != ULLONG_MAX) {
+			now = sched_clock();
+			timeout = next > now ? nsecs_to_jiffies(next - now) + 1 : 0;
+		}
 
-		psi_poll_work(group);
+		wait_event_interruptible_timeout(psi_poll_wait,
+				atomic_cmpxchg(&psi_poll_wakeup, 1, 0) ||
+				kthread_should_stop(), timeout);
 	}
 	return 0;
 }
 
 static void poll_timer_fn(struct timer_list *t)
 {
-	struct psi_group *group = from_timer(group, t, poll_timer);
-
-	atomic_set(&group->poll_wakeup, 1);
-	wake_up_interruptible(&group->poll_wait);
+	atomic_set(&psi_poll_wakeup, 1);
+	wake_up_interruptible(&psi_poll_wait);
 }
 
 static void record_times(struct psi_group_cpu *groupc, u64 now)
@@ -685,16 +804,35 @@ static void record_times(struct psi_group_cpu *groupc, u64 now)
 		groupc->times[PSI_NONIDLE] += delta;
 }
 
+/*
+ * The group just left idle on @cpu: make sure the aggregators, which skip
+ * CPUs they found idle, look at it again.
+ */
+static void psi_mark_active(struct psi_group *group, int cpu)
+{
+	int a;
+
+	/* Pairs with the barrier in collect_percpu_times() */
+	smp_mb();
+
+	for (a = 0; a < NR_PSI_AGGREGATORS; a++) {
+		if (!cpumask_test_cpu(cpu, group->active_cpus[a]))
+			cpumask_set_cpu(cpu, group->active_cpus[a]);
+	}
+}
+
 static void psi_group_change(struct psi_group *group, int cpu,
 			     unsigned int clear, unsigned int set, u64 now,
 			     bool wake_clock)
 {
 	struct psi_group_cpu *groupc;
 	u32 state_mask = 0;
+	u32 prev_state_mask;
 	unsigned int t, m;
 	enum psi_states s;
 
 	groupc = per_cpu_ptr(group->pcpu, cpu);
+	prev_state_mask = groupc->state_mask;
 
 	/*
 	 * First we assess the aggregate resource states this CPU's
@@ -744,12 +882,15 @@ static void psi_group_change(struct psi_group *group, int cpu,
 	if (unlikely(groupc->tasks[NR_ONCPU] && cpu_curr(cpu)->in_memstall))
 		state_mask |= (1 << PSI_MEM_FULL);
 
-	groupc->state_mask = state_mask;
+	WRITE_ONCE(groupc->state_mask, state_mask);
 
 	write_seqcount_end(&groupc->seq);
 
+	if (!prev_state_mask && state_mask)
+		psi_mark_active(group, cpu);
+
 	if (state_mask & group->poll_states)
-		psi_schedule_poll_work(group, 1);
+		psi_schedule_poll_work(group);
 
 	if (wake_clock && !delayed_work_pending(&group->avgs_work))
 		schedule_delayed_work(&group->avgs_work, PSI_FREQ);
@@ -964,7 +1105,11 @@ int psi_cgroup_alloc(struct cgroup *cgroup)
 		kfree(cgroup->psi);
 		return -ENOMEM;
 	}
-	group_init(cgroup->psi);
+	if (group_init(cgroup->psi)) {
+		free_percpu(cgroup->psi->pcpu);
+		kfree(cgroup->psi);
+		return -ENOMEM;
+	}
 	return 0;
 }
 
@@ -975,8 +1120,10 @@ void psi_cgroup_free(struct cgroup *cgroup)
 
 	cancel_delayed_work_sync(&cgroup->psi->avgs_work);
 	free_percpu(cgroup->psi->pcpu);
+	group_free_masks(cgroup->psi);
 	/* All triggers must be removed by now */
 	WARN_ONCE(cgroup->psi->poll_states, "psi: trigger leak\n");
+	WARN_ONCE(!list_empty(&cgroup->psi->poll_node), "psi: group still polled\n");
 	kfree(cgroup->psi);
 }
 
@@ -1133,21 +1280,24 @@ struct psi_trigger *psi_trigger_create(struct psi_group *group,
 	init_waitqueue_head(&t->event_wait);
 	t->pending_event = false;
 
-	mutex_lock(&group->trigger_lock);
-
-	if (!rcu_access_pointer(group->poll_task)) {
+	mutex_lock(&psi_poll_mutex);
+	if (!psi_poll_task) {
 		struct task_struct *task;
 
-		task = kthread_create(psi_poll_worker, group, "psimon");
+		task = kthread_create(psi_poll_worker, NULL, "psimon");
 		if (IS_ERR(task)) {
+			mutex_unlock(&psi_poll_mutex);
 			kfree(t);
-			mutex_unlock(&group->trigger_lock);
 			return ERR_CAST(task);
 		}
-		atomic_set(&group->poll_wakeup, 0);
+		atomic_set(&psi_poll_wakeup, 0);
 		wake_up_process(task);
-		rcu_assign_pointer(group->poll_task, task);
+		psi_poll_task = task;
 	}
+	psi_poll_users++;
+	mutex_unlock(&psi_poll_mutex);
+
+	mutex_lock(&group->trigger_lock);
 
 	list_add(&t->node, &group->triggers);
 	group->poll_min_period = min(group->poll_min_period,
@@ -1164,6 +1314,7 @@ void psi_trigger_destroy(struct psi_trigger *t)
 {
 	struct psi_group *group;
 	struct task_struct *task_to_destroy = NULL;
+	bool removed = false;
 
 	/*
 	 * We do not check psi_disabled since it might have been disabled after
@@ -1194,36 +1345,41 @@ void psi_trigger_destroy(struct psi_trigger *t)
 			period = min(period, div_u64(tmp->win.size,
 					UPDATES_PER_WINDOW));
 		group->poll_min_period = period;
-		/* Destroy poll_task when the last trigger is destroyed */
-		if (group->poll_states == 0) {
+		if (group->poll_states == 0)
 			group->polling_until = 0;
-			task_to_destroy = rcu_dereference_protected(
-					group->poll_task,
-					lockdep_is_held(&group->trigger_lock));
-			rcu_assign_pointer(group->poll_task, NULL);
-			del_timer(&group->poll_timer);
-		}
+		removed = true;
 	}
 
 	mutex_unlock(&group->trigger_lock);
 
 	/*
-	 * Wait for psi_schedule_poll_work RCU to complete its read-side
-	 * critical section before destroying the trigger and optionally the
-	 * poll_task.
+	 * Wait for the scheduler hot path, which runs with preemption
+	 * disabled, to stop queueing the group for polling.
 	 */
 	synchronize_rcu();
+
+	mutex_lock(&psi_poll_mutex);
+	if (removed) {
+		/* Take the group out of the worker's hands if it's unwatched */
+		if (!READ_ONCE(group->poll_states)) {
+			psi_poll_drain(sched_clock());
+			list_del_init(&group->poll_node);
+			atomic_set(&group->poll_scheduled, 0);
+		}
+		/* Stop kthread 'psimon' when the last trigger is destroyed */
+		if (!--psi_poll_users) {
+			task_to_destroy = psi_poll_task;
+			psi_poll_task = NULL;
+		}
+	}
+	mutex_unlock(&psi_poll_mutex);
+
 	/*
-	 * Stop kthread 'psimon' after releasing trigger_lock to prevent a
-	 * deadlock while waiting for psi_poll_work to acquire trigger_lock
+	 * Stop the worker outside of psi_poll_mutex, which it takes on
+	 * every pass.
 	 */
-	if (task_to_destroy) {
-		/*
-		 * After the RCU grace period has expired, the worker
-		 * can no longer be found through group->poll_task.
-		 */
+	if (task_to_destroy)
 		kthread_stop(task_to_destroy);
-	}
 	kfree(t);
 }
 
@@ -394,6 +394,9 @@ struct task_group {
 	/* A positive value indicates that this is a SCHED_IDLE group. */
 	int			idle;
 
+	/* latency priority of the group. */
+	int			latency_prio;
+
 #ifdef	CONFIG_SMP
 	/*
 	 * load_avg can be heavily contended at clock tick time, so put
@@ -503,6 +506,8 @@ extern int sched_group_set_shares(struct task_group *tg, unsigned long shares);
 
 extern int sched_group_set_idle(struct task_group *tg, long idle);
 
+extern int sched_group_set_latency(struct task_group *tg, int prio);
+
 #ifdef CONFIG_SMP
 extern void set_task_rq_fair(struct sched_entity *se,
 			     struct cfs_rq *prev, struct cfs_rq *next);
@@ -571,6 +576,9 @@ struct cfs_rq {
 
 	u64			exec_clock;
 	u64			min_vruntime;
+	/* Weighted sum of queued entity keys, see avg_vruntime() */
+	s64			avg_vruntime;
+	u64			avg_load;
 #ifdef CONFIG_SCHED_CORE
 	unsigned int		forceidle_seq;
 	u64			min_vruntime_fi;
@@ -1085,6 +1093,8 @@ struct rq {
 
 	/* This is used to determine avg_idle's max value */
 	u64			max_idle_balance_cost;
+	/* Idle time newidle_balance() may still spend on a pull */
+	u64			newidle_budget;
 
 #ifdef CONFIG_HOTPLUG_CPU
 	struct rcuwait		hotplug_wait;
@@ -1407,6 +1417,17 @@ static inline void update_idle_core(struct rq *rq)
 static inline void update_idle_core(struct rq *rq) { }
 #endif
 
+#ifdef CONFIG_SMP
+extern void __update_idle_cpumask(int cpu, bool idle);
+
+static inline void update_idle_cpumask(struct rq *rq, bool idle)
+{
+	__update_idle_cpumask(cpu_of(rq), idle);
+}
+#else
+static inline void update_idle_cpumask(struct rq *rq, bool idle) { }
+#endif
+
 #ifdef CONFIG_FAIR_GROUP_SCHED
 static inline struct task_struct *task_of(struct sched_entity *se)
 {
@@ -2357,6 +2378,7 @@ extern void init_sched_rt_class(void);
 extern void init_sched_fair_class(void);
 
 extern void reweight_task(struct task_struct *p, int prio);
+extern void set_latency_offset(struct task_struct *p);
 
 extern void resched_curr(struct rq *rq);
 extern void resched_cpu(int cpu);
@@ -3207,4 +3229,61 @@ extern int sched_dynamic_mode(const char *str);
 extern void sched_dynamic_update(int mode);
 #endif
 
+#ifdef CONFIG_SCHED_MM_CID
+static inline int mm_cid_get(struct mm_struct *mm)
+{
+	struct cpumask *cpumask;
+	int cid;
+
+	lockdep_assert_irqs_disabled();
+	cpumask = mm_cidmask(mm);
+	raw_spin_lock(&mm->cid_lock);
+	cid = cpumask_first_zero(cpumask);
+	if (cid < nr_cpu_ids)
+		__cpumask_set_cpu(cid, cpumask);
+	else
+		cid = -1;
+	raw_spin_unlock(&mm->cid_lock);
+	return cid;
+}
+
+static inline void mm_cid_put(struct mm_struct *mm, int cid)
+{
+	lockdep_assert_irqs_disabled();
+	if (cid < 0)
+		return;
+	raw_spin_lock(&mm->cid_lock);
+	__cpumask_clear_cpu(cid, mm_cidmask(mm));
+	raw_spin_unlock(&mm->cid_lock);
+}
+
+/*
+ * A concurrency ID is only held while a task runs, so at most one per CPU
+ * is in use for a given mm, and the IDs handed out stay below both the
+ * number of threads and the number of CPUs the mm runs on. rseq_preempt()
+ * on switch out makes sure user-space sees the new ID on its way back.
+ */
+static inline void switch_mm_cid(struct task_struct *prev, struct task_struct *next)
+{
+	if (prev->mm_cid_active) {
+		if (next->mm_cid_active && next->mm == prev->mm) {
+			/*
+			 * Context switch between threads in same mm, hand over
+			 * the mm_cid from prev to next.
+			 */
+			next->mm_cid = prev->mm_cid;
+			prev->mm_cid = -1;
+			return;
+		}
+		mm_cid_put(prev->mm, prev->mm_cid);
+		prev->mm_cid = -1;
+	}
+	if (next->mm_cid_active)
+		next->mm_cid = mm_cid_get(next->mm);
+}
+
+#else
+static inline void switch_mm_cid(struct task_struct *prev, struct task_struct *next) { }
+#endif
+
 #endif /* _KERNEL_SCHED_SCHED_H */
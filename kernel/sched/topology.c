@@ -689,6 +689,16 @@ static void update_top_cache_domain(int cpu)
 	per_cpu(sd_llc_id, cpu) = id;
 	rcu_assign_pointer(per_cpu(sd_llc_shared, cpu), sds);
 
+	/*
+	 * A CPU that is already idle won't pass through set_next_task_idle()
+	 * again until it has run something, so start out claiming it is idle;
+	 * select_idle_cpu() verifies every hint before using it.
+	 */
+	if (sds) {
+		cpumask_set_cpu(cpu, sds_idle_cpus(sds));
+		cpumask_set_cpu(cpu, sds_idle_cores(sds));
+	}
+
 	sd = lowest_flag_domain(cpu, SD_NUMA);
 	rcu_assign_pointer(per_cpu(sd_numa, cpu), sd);
 
@@ -2106,7 +2116,7 @@ static int __sdt_alloc(const struct cpumask *cpu_map)
 
 			*per_cpu_ptr(sdd->sd, j) = sd;
 
-			sds = kzalloc_node(sizeof(struct sched_domain_shared),
+			sds = kzalloc_node(sizeof(struct sched_domain_shared) + 2 * cpumask_size(),
 					GFP_KERNEL, cpu_to_node(j));
 			if (!sds)
 				return -ENOMEM;
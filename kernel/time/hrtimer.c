@@ -26,6 +26,7 @@
 #include <linux/export.h>
 #include <linux/percpu.h>
 #include <linux/hrtimer.h>
+#include <linux/log2.h>
 #include <linux/notifier.h>
 #include <linux/syscalls.h>
 #include <linux/interrupt.h>
@@ -678,6 +679,7 @@ static void __hrtimer_reprogram(struct hrtimer_cpu_base *cpu_base,
 	if (!__hrtimer_hres_active(cpu_base) || cpu_base->hang_detected)
 		return;
 
+	cpu_base->nr_reprograms++;
 	tick_program_event(expires_next, 1);
 }
 
@@ -719,6 +721,49 @@ static int __init setup_hrtimer_hres(char *str)
 
 __setup("highres=", setup_hrtimer_hres);
 
+/*
+ * Expiry coalescing granularity in nanoseconds, a power of two. Timers
+ * started with at least this much slack get their hard expiry rounded down
+ * onto a multiple of it, so nearby timers share one clock event and are
+ * expired by the same interrupt. 0 disables coalescing.
+ */
+static u64 hrtimer_coalesce_ns __read_mostly;
+
+static int __init setup_hrtimer_coalesce(char *str)
+{
+	u64 val;
+
+	if (kstrtoull(str, 0, &val))
+		return 0;
+
+	hrtimer_coalesce_ns = val ? rounddown_pow_of_two(val) : 0;
+	return 1;
+}
+
+__setup("hrtimer_coalesce=", setup_hrtimer_coalesce);
+
+/*
+ * Move the hard expiry of @timer onto the coalescing grid if its slack
+ * allows it. The soft expiry is left alone, so the timer never fires
+ * earlier than requested.
+ */
+static void hrtimer_coalesce_expires(struct hrtimer *timer, u64 delta_ns)
+{
+	u64 grain = hrtimer_coalesce_ns;
+	ktime_t expires, aligned;
+
+	if (!grain || delta_ns < grain || !hrtimer_hres_active())
+		return;
+
+	expires = hrtimer_get_expires(timer);
+	if (expires < 0 || expires == KTIME_MAX)
+		return;
+
+	aligned = expires & ~(ktime_t)(grain - 1);
+	if (aligned >= hrtimer_get_softexpires(timer))
+		timer->node.expires = aligned;
+}
+
 /*
  * hrtimer_high_res_enabled - query, if the highres mode is enabled
  */
@@ -753,6 +798,8 @@ static void hrtimer_switch_to_hres(void)
 
 static inline int hrtimer_is_hres_enabled(void) { return 0; }
 static inline void hrtimer_switch_to_hres(void) { }
+static inline void hrtimer_coalesce_expires(struct hrtimer *timer,
+					    u64 delta_ns) { }
 
 #endif /* CONFIG_HIGH_RES_TIMERS */
 /*
@@ -851,8 +898,11 @@ static void hrtimer_reprogram(struct hrtimer *timer, bool reprogram)
 	if (base->cpu_base != cpu_base)
 		return;
 
-	if (expires >= cpu_base->expires_next)
+	if (expires >= cpu_base->expires_next) {
+		if (expires == cpu_base->expires_next)
+			cpu_base->nr_coalesced++;
 		return;
+	}
 
 	/*
 	 * If the hrtimer interrupt is running, then it will reevaluate the
@@ -1246,6 +1296,7 @@ static int __hrtimer_start_range_ns(struct hrtimer *timer, ktime_t tim,
 	tim = hrtimer_update_lowres(timer, tim, mode);
 
 	hrtimer_set_expires_range_ns(timer, tim, delta_ns);
+	hrtimer_coalesce_expires(timer, delta_ns);
 
 	/* Switch the timer base, if necessary: */
 	if (!force_local) {
@@ -1746,6 +1797,7 @@ static void __hrtimer_run_queues(struct hrtimer_cpu_base *cpu_base, ktime_t now,
 			if (basenow < hrtimer_get_softexpires_tv64(timer))
 				break;
 
+			cpu_base->nr_expired++;
 			__run_hrtimer(cpu_base, base, timer, &basenow, flags);
 			if (active_mask == HRTIMER_ACTIVE_SOFT)
 				hrtimer_sync_wait_running(cpu_base, flags);
@@ -1821,6 +1873,7 @@ void hrtimer_interrupt(struct clock_event_device *dev)
 	raw_spin_unlock_irqrestore(&cpu_base->lock, flags);
 
 	/* Reprogramming necessary ? */
+	cpu_base->nr_reprograms++;
 	if (!tick_program_event(expires_next, 0)) {
 		cpu_base->hang_detected = 0;
 		return;
@@ -1865,6 +1918,7 @@ void hrtimer_interrupt(struct clock_event_device *dev)
 		expires_next = ktime_add_ns(now, 100 * NSEC_PER_MSEC);
 	else
 		expires_next = ktime_add(now, delta);
+	cpu_base->nr_reprograms++;
 	tick_program_event(expires_next, 1);
 	pr_warn_once("hrtimer: interrupt took %llu ns\n", ktime_to_ns(delta));
 }
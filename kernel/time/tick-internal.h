@@ -164,8 +164,28 @@ static inline void timers_update_nohz(void) { }
 DECLARE_PER_CPU(struct hrtimer_cpu_base, hrtimer_bases);
 
 extern u64 get_next_timer_interrupt(unsigned long basej, u64 basem);
+u64 timer_set_idle(unsigned long basej, u64 basem);
 void timer_clear_idle(void);
 
+#ifdef CONFIG_TIMER_MIGRATION
+extern bool timer_expire_remote(unsigned int cpu, unsigned long *nextexp);
+extern void tmigr_handle_remote(void);
+extern bool tmigr_requires_handle_remote(void);
+extern void tmigr_cpu_activate(void);
+extern bool tmigr_cpu_deactivate(bool pending, unsigned long nextexp,
+				 unsigned long *wakeup);
+#else
+static inline void tmigr_handle_remote(void) { }
+static inline bool tmigr_requires_handle_remote(void) { return false; }
+static inline void tmigr_cpu_activate(void) { }
+static inline bool tmigr_cpu_deactivate(bool pending, unsigned long nextexp,
+					unsigned long *wakeup)
+{
+	*wakeup = nextexp;
+	return pending;
+}
+#endif
+
 #define CLOCK_SET_WALL							\
 	(BIT(HRTIMER_BASE_REALTIME) | BIT(HRTIMER_BASE_REALTIME_SOFT) |	\
 	 BIT(HRTIMER_BASE_TAI) | BIT(HRTIMER_BASE_TAI_SOFT))
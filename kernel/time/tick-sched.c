@@ -239,6 +239,12 @@ static void tick_sched_handle(struct tick_sched *ts, struct pt_regs *regs)
 		 */
 		ts->next_tick = 0;
 	}
+#endif
+#ifdef CONFIG_NO_HZ_FULL
+	/* Every tick a busy isolated CPU takes is jitter for its task */
+	if (tick_nohz_full_cpu(smp_processor_id()) && !is_idle_task(current))
+		trace_tick_nohz_full_interrupt(smp_processor_id(), false,
+					       ++ts->full_ticks);
 #endif
 	update_process_times(user_mode(regs));
 	profile_tick(CPU_PROFILING);
@@ -308,7 +314,11 @@ static bool can_stop_full_tick(int cpu, struct tick_sched *ts)
 
 static void nohz_full_kick_func(struct irq_work *work)
 {
-	/* Empty, the tick restart happens on tick_nohz_irq_exit() */
+	struct tick_sched *ts = this_cpu_ptr(&tick_cpu_sched);
+
+	/* The tick restart happens on tick_nohz_irq_exit() */
+	trace_tick_nohz_full_interrupt(smp_processor_id(), true,
+				       ++ts->full_kicks);
 }
 
 static DEFINE_PER_CPU(struct irq_work, nohz_full_kick_work) =
@@ -782,9 +792,29 @@ static inline bool local_timer_softirq_pending(void)
 	return local_softirq_pending() & BIT(TIMER_SOFTIRQ);
 }
 
+/*
+ * If this CPU is the one which had the do_timer() duty last, we limit the
+ * sleep time to the timekeeping max_deferment value. Otherwise we can sleep
+ * as long as we want.
+ */
+static u64 tick_nohz_max_expires(struct tick_sched *ts, int cpu)
+{
+	u64 basemono = ts->timer_expires_base;
+	u64 delta = timekeeping_max_deferment();
+
+	if (cpu != tick_do_timer_cpu &&
+	    (tick_do_timer_cpu != TICK_DO_TIMER_NONE || !ts->do_timer_last))
+		delta = KTIME_MAX;
+
+	/* Calculate the next expiry time */
+	if (delta < (KTIME_MAX - basemono))
+		return basemono + delta;
+	return KTIME_MAX;
+}
+
 static ktime_t tick_nohz_next_event(struct tick_sched *ts, int cpu)
 {
-	u64 basemono, next_tick, delta, expires;
+	u64 basemono, next_tick, delta;
 	unsigned long basejiff;
 	unsigned int seq;
 
@@ -843,23 +873,8 @@ static ktime_t tick_nohz_next_event(struct tick_sched *ts, int cpu)
 		}
 	}
 
-	/*
-	 * If this CPU is the one which had the do_timer() duty last, we limit
-	 * the sleep time to the timekeeping max_deferment value.
-	 * Otherwise we can sleep as long as we want.
-	 */
-	delta = timekeeping_max_deferment();
-	if (cpu != tick_do_timer_cpu &&
-	    (tick_do_timer_cpu != TICK_DO_TIMER_NONE || !ts->do_timer_last))
-		delta = KTIME_MAX;
-
-	/* Calculate the next expiry time */
-	if (delta < (KTIME_MAX - basemono))
-		expires = basemono + delta;
-	else
-		expires = KTIME_MAX;
-
-	ts->timer_expires = min_t(u64, expires, next_tick);
+	ts->timer_expires = min_t(u64, tick_nohz_max_expires(ts, cpu),
+				  next_tick);
 
 out:
 	return ts->timer_expires;
@@ -1084,6 +1099,29 @@ static bool can_stop_idle_tick(int cpu, struct tick_sched *ts)
 	return true;
 }
 
+/*
+ * tick_nohz_next_event() only looks at the timers, which is all
+ * tick_nohz_get_sleep_length() needs, and its expiry still includes the
+ * global timers of this CPU. Once the idle tick is stopped for real, hand
+ * those over to the timer migration hierarchy and start over from what is
+ * left: the local timers, plus the first global event of the hierarchy if
+ * this CPU is the migrator.
+ */
+static void tick_nohz_idle_set_timers(struct tick_sched *ts, int cpu)
+{
+	u64 basemono = ts->timer_expires_base;
+	u64 next_tick;
+
+	/* Due in the next period anyway, the bases were not marked idle */
+	if (ts->timer_expires - basemono <= (u64)TICK_NSEC)
+		return;
+
+	next_tick = timer_set_idle(ts->last_jiffies, basemono);
+	ts->next_timer = next_tick;
+	ts->timer_expires = min_t(u64, tick_nohz_max_expires(ts, cpu),
+				  next_tick);
+}
+
 static void __tick_nohz_idle_stop_tick(struct tick_sched *ts)
 {
 	ktime_t expires;
@@ -1105,10 +1143,11 @@ static void __tick_nohz_idle_stop_tick(struct tick_sched *ts)
 	if (expires > 0LL) {
 		int was_stopped = ts->tick_stopped;
 
+		tick_nohz_idle_set_timers(ts, cpu);
 		tick_nohz_stop_tick(ts, cpu);
 
 		ts->idle_sleeps++;
-		ts->idle_expires = expires;
+		ts->idle_expires = ts->timer_expires;
 
 		if (!was_stopped && ts->tick_stopped) {
 			ts->idle_jiffies = ts->last_jiffies;
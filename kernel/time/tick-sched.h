@@ -51,6 +51,9 @@ enum tick_nohz_mode {
  * @tick_dep_mask:	Tick dependency mask - is set, if someone needs the tick
  * @last_tick_jiffies:	Value of jiffies seen on last tick
  * @stalled_jiffies:	Number of stalled jiffies detected across ticks
+ * @full_ticks:		Ticks taken on a nohz_full CPU while a task was running
+ * @full_kicks:		Kicks of a nohz_full CPU to re-evaluate its tick
+ *			dependencies
  */
 struct tick_sched {
 	struct hrtimer			sched_timer;
@@ -81,6 +84,8 @@ struct tick_sched {
 	atomic_t			tick_dep_mask;
 	unsigned long			last_tick_jiffies;
 	unsigned int			stalled_jiffies;
+	unsigned long			full_ticks;
+	unsigned long			full_kicks;
 };
 
 extern struct tick_sched *tick_get_tick_sched(int cpu);
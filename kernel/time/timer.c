@@ -41,6 +41,7 @@
 #include <linux/sched/sysctl.h>
 #include <linux/sched/nohz.h>
 #include <linux/sched/debug.h>
+#include <linux/sched/isolation.h>
 #include <linux/slab.h>
 #include <linux/compat.h>
 #include <linux/random.h>
@@ -181,18 +182,22 @@ EXPORT_SYMBOL(jiffies_64);
 #define WHEEL_TIMEOUT_MAX	(WHEEL_TIMEOUT_CUTOFF - LVL_GRAN(LVL_DEPTH - 1))
 
 /*
- * The resulting wheel size. If NOHZ is configured we allocate two
- * wheels so we have a separate storage for the deferrable timers.
+ * The resulting wheel size. If NOHZ is configured we allocate three
+ * wheels: one for the pinned timers, one for the global ones, which
+ * the timer migration hierarchy may expire on another CPU while this
+ * one is idle, and one for the deferrable timers.
  */
 #define WHEEL_SIZE	(LVL_SIZE * LVL_DEPTH)
 
 #ifdef CONFIG_NO_HZ_COMMON
-# define NR_BASES	2
+# define NR_BASES	3
 # define BASE_STD	0
-# define BASE_DEF	1
+# define BASE_GLOBAL	1
+# define BASE_DEF	2
 #else
 # define NR_BASES	1
 # define BASE_STD	0
+# define BASE_GLOBAL	0
 # define BASE_DEF	0
 #endif
 
@@ -209,6 +214,7 @@ struct timer_base {
 	bool			next_expiry_recalc;
 	bool			is_idle;
 	bool			timers_pending;
+	bool			expiring;
 	DECLARE_BITMAP(pending_map, WHEEL_SIZE);
 	struct hlist_head	vectors[WHEEL_SIZE];
 } ____cacheline_aligned;
@@ -236,6 +242,11 @@ static void timers_update_migration(void)
 		static_branch_disable(&timers_migration_enabled);
 }
 
+static inline bool is_timers_migration_enabled(void)
+{
+	return static_branch_likely(&timers_migration_enabled);
+}
+
 #ifdef CONFIG_SYSCTL
 static int timer_migration_handler(struct ctl_table *table, int write,
 			    void *buffer, size_t *lenp, loff_t *ppos)
@@ -272,6 +283,7 @@ device_initcall(timer_sysctl_init);
 #endif /* CONFIG_SYSCTL */
 #else /* CONFIG_SMP */
 static inline void timers_update_migration(void) { }
+static inline bool is_timers_migration_enabled(void) { return false; }
 #endif /* !CONFIG_SMP */
 
 static void timer_update_keys(struct work_struct *work)
@@ -906,10 +918,13 @@ static inline struct timer_base *get_timer_cpu_base(u32 tflags, u32 cpu)
 
 	/*
 	 * If the timer is deferrable and NO_HZ_COMMON is set then we need
-	 * to use the deferrable base.
+	 * to use the deferrable base. Timers which are not pinned go to the
+	 * global base.
 	 */
 	if (IS_ENABLED(CONFIG_NO_HZ_COMMON) && (tflags & TIMER_DEFERRABLE))
 		base = per_cpu_ptr(&timer_bases[BASE_DEF], cpu);
+	else if (IS_ENABLED(CONFIG_NO_HZ_COMMON) && !(tflags & TIMER_PINNED))
+		base = per_cpu_ptr(&timer_bases[BASE_GLOBAL], cpu);
 	return base;
 }
 
@@ -919,10 +934,13 @@ static inline struct timer_base *get_timer_this_cpu_base(u32 tflags)
 
 	/*
 	 * If the timer is deferrable and NO_HZ_COMMON is set then we need
-	 * to use the deferrable base.
+	 * to use the deferrable base. Timers which are not pinned go to the
+	 * global base.
 	 */
 	if (IS_ENABLED(CONFIG_NO_HZ_COMMON) && (tflags & TIMER_DEFERRABLE))
 		base = this_cpu_ptr(&timer_bases[BASE_DEF]);
+	else if (IS_ENABLED(CONFIG_NO_HZ_COMMON) && !(tflags & TIMER_PINNED))
+		base = this_cpu_ptr(&timer_bases[BASE_GLOBAL]);
 	return base;
 }
 
@@ -931,13 +949,21 @@ static inline struct timer_base *get_timer_base(u32 tflags)
 	return get_timer_cpu_base(tflags, tflags & TIMER_CPUMASK);
 }
 
+/*
+ * Timers are queued on the local CPU. Instead of guessing a busy target at
+ * enqueue time, the timer migration hierarchy expires the global timers of
+ * this CPU elsewhere once it goes idle. Isolated CPUs are the exception:
+ * their non pinned timers are handed to a housekeeping CPU right away, so
+ * the expiry never interrupts the isolated task.
+ */
 static inline struct timer_base *
 get_target_base(struct timer_base *base, unsigned tflags)
 {
-#if defined(CONFIG_SMP) && defined(CONFIG_NO_HZ_COMMON)
-	if (static_branch_likely(&timers_migration_enabled) &&
-	    !(tflags & TIMER_PINNED))
-		return get_timer_cpu_base(tflags, get_nohz_timer_target());
+#ifdef CONFIG_NO_HZ_FULL
+	if (!(tflags & TIMER_PINNED) &&
+	    !housekeeping_cpu(smp_processor_id(), HK_TYPE_TIMER))
+		return get_timer_cpu_base(tflags,
+					  housekeeping_any_cpu(HK_TYPE_TIMER));
 #endif
 	return get_timer_this_cpu_base(tflags);
 }
@@ -1212,6 +1238,8 @@ void add_timer_on(struct timer_list *timer, int cpu)
 
 	BUG_ON(timer_pending(timer) || !timer->function);
 
+	/* The timer must stay on @cpu, keep it out of the global base */
+	timer->flags |= TIMER_PINNED;
 	new_base = get_timer_cpu_base(timer->flags, cpu);
 
 	/*
@@ -1678,28 +1706,15 @@ static u64 cmp_next_hrtimer_event(u64 basem, u64 expires)
 	return DIV_ROUND_UP_ULL(nextevt, TICK_NSEC) * TICK_NSEC;
 }
 
-/**
- * get_next_timer_interrupt - return the time (clock mono) of the next timer
- * @basej:	base time jiffies
- * @basem:	base time clock monotonic
- *
- * Returns the tick aligned clock monotonic time of the next pending
- * timer or KTIME_MAX if no timer is pending.
+/*
+ * Recalculate the next expiry of @base if required and forward its clk
+ * towards @basej. Must be called with base->lock held.
  */
-u64 get_next_timer_interrupt(unsigned long basej, u64 basem)
+static unsigned long next_timer_base_expiry(struct timer_base *base,
+					    unsigned long basej)
 {
-	struct timer_base *base = this_cpu_ptr(&timer_bases[BASE_STD]);
-	u64 expires = KTIME_MAX;
 	unsigned long nextevt;
 
-	/*
-	 * Pretend that there is no timer pending if the cpu is offline.
-	 * Possible pending timers will be migrated later to an active cpu.
-	 */
-	if (cpu_is_offline(smp_processor_id()))
-		return expires;
-
-	raw_spin_lock(&base->lock);
 	if (base->next_expiry_recalc)
 		base->next_expiry = __next_timer_interrupt(base);
 	nextevt = base->next_expiry;
@@ -1715,28 +1730,135 @@ u64 get_next_timer_interrupt(unsigned long basej, u64 basem)
 		else if (time_after(nextevt, base->clk))
 			base->clk = nextevt;
 	}
+	return nextevt;
+}
+
+static u64 next_timer_to_expires(unsigned long nextevt, bool pending,
+				 unsigned long basej, u64 basem)
+{
+	if (!pending)
+		return KTIME_MAX;
+	if (time_before_eq(nextevt, basej))
+		return basem;
+	return basem + (u64)(nextevt - basej) * TICK_NSEC;
+}
+
+static u64 __get_next_timer_interrupt(unsigned long basej, u64 basem,
+				      bool idle)
+{
+	struct timer_base *base_local, *base_global;
+	unsigned long nextevt, nextevt_local, nextevt_global, wakeup;
+	bool pending_local, pending_global;
+	u64 expires = KTIME_MAX;
+
+	/*
+	 * Pretend that there is no timer pending if the cpu is offline.
+	 * Possible pending timers will be migrated later to an active cpu.
+	 */
+	if (cpu_is_offline(smp_processor_id()))
+		return expires;
+
+	base_local = this_cpu_ptr(&timer_bases[BASE_STD]);
+	base_global = this_cpu_ptr(&timer_bases[BASE_GLOBAL]);
+
+	raw_spin_lock(&base_local->lock);
+	raw_spin_lock_nested(&base_global->lock, SINGLE_DEPTH_NESTING);
+
+	nextevt_local = next_timer_base_expiry(base_local, basej);
+	nextevt_global = next_timer_base_expiry(base_global, basej);
+	pending_local = base_local->timers_pending;
+	pending_global = base_global->timers_pending;
+
+	nextevt = nextevt_local;
+	if (time_before(nextevt_global, nextevt))
+		nextevt = nextevt_global;
 
 	if (time_before_eq(nextevt, basej)) {
 		expires = basem;
-		base->is_idle = false;
+		base_local->is_idle = false;
+		base_global->is_idle = false;
 	} else {
-		if (base->timers_pending)
-			expires = basem + (u64)(nextevt - basej) * TICK_NSEC;
+		expires = next_timer_to_expires(nextevt,
+						pending_local || pending_global,
+						basej, basem);
 		/*
-		 * If we expect to sleep more than a tick, mark the base idle.
+		 * If we expect to sleep more than a tick, mark the bases idle.
 		 * Also the tick is stopped so any added timer must forward
 		 * the base clk itself to keep granularity small. This idle
-		 * logic is only maintained for the BASE_STD base, deferrable
-		 * timers may still see large granularity skew (by design).
+		 * logic is only maintained for the BASE_STD and BASE_GLOBAL
+		 * bases, deferrable timers may still see large granularity
+		 * skew (by design).
 		 */
-		if ((expires - basem) > TICK_NSEC)
-			base->is_idle = true;
+		if ((expires - basem) > TICK_NSEC) {
+			base_local->is_idle = true;
+			base_global->is_idle = true;
+		}
+	}
+
+	/*
+	 * Going idle: hand the global timers over to the migration
+	 * hierarchy. This CPU then only has to wake up for its pinned
+	 * timers, unless it is the last one to go idle and has to take
+	 * care of the first global event of the whole hierarchy. With
+	 * timer_migration disabled the CPU keeps its global timers, but
+	 * still reports its idle state so the hierarchy stays consistent.
+	 */
+	if (idle && base_local->is_idle) {
+		bool migrate = is_timers_migration_enabled();
+		bool pending = pending_local;
+
+		if (migrate)
+			nextevt = nextevt_local;
+		else
+			pending |= pending_global;
+
+		if (tmigr_cpu_deactivate(migrate && pending_global,
+					 nextevt_global, &wakeup)) {
+			if (!pending || time_before(wakeup, nextevt))
+				nextevt = wakeup;
+			pending = true;
+		}
+		expires = next_timer_to_expires(nextevt, pending, basej, basem);
 	}
-	raw_spin_unlock(&base->lock);
+
+	raw_spin_unlock(&base_global->lock);
+	raw_spin_unlock(&base_local->lock);
 
 	return cmp_next_hrtimer_event(basem, expires);
 }
 
+/**
+ * get_next_timer_interrupt - return the time (clock mono) of the next timer
+ * @basej:	base time jiffies
+ * @basem:	base time clock monotonic
+ *
+ * Returns the tick aligned clock monotonic time of the next pending
+ * timer or KTIME_MAX if no timer is pending. The global timers are
+ * included, the timer migration hierarchy is not touched.
+ */
+u64 get_next_timer_interrupt(unsigned long basej, u64 basem)
+{
+	return __get_next_timer_interrupt(basej, basem, false);
+}
+
+/**
+ * timer_set_idle - hand the global timers over to the migration hierarchy
+ * @basej:	base time jiffies
+ * @basem:	base time clock monotonic
+ *
+ * Called with interrupts disabled when the idle tick is stopped. If the
+ * bases are idle, the global timers are handed to the timer migration
+ * hierarchy and the returned value only covers the pinned timers plus
+ * whatever wakeup the hierarchy asks for. Undone by timer_clear_idle().
+ *
+ * Returns the tick aligned clock monotonic time of the next event or
+ * KTIME_MAX if there is none.
+ */
+u64 timer_set_idle(unsigned long basej, u64 basem)
+{
+	return __get_next_timer_interrupt(basej, basem, true);
+}
+
 /**
  * timer_clear_idle - Clear the idle state of the timer base
  *
@@ -1744,21 +1866,27 @@ u64 get_next_timer_interrupt(unsigned long basej, u64 basem)
  */
 void timer_clear_idle(void)
 {
-	struct timer_base *base = this_cpu_ptr(&timer_bases[BASE_STD]);
-
 	/*
 	 * We do this unlocked. The worst outcome is a remote enqueue sending
 	 * a pointless IPI, but taking the lock would just make the window for
 	 * sending the IPI a few instructions smaller for the cost of taking
 	 * the lock in the exit from idle path.
 	 */
-	base->is_idle = false;
+	__this_cpu_write(timer_bases[BASE_STD].is_idle, false);
+	__this_cpu_write(timer_bases[BASE_GLOBAL].is_idle, false);
+
+	/* Take the global timers back from the migration hierarchy */
+	tmigr_cpu_activate();
 }
 #endif
 
 /**
  * __run_timers - run all expired timers (if any) on this CPU.
  * @base: the timer vector to be processed.
+ *
+ * The global base of an idle CPU may be expired from another CPU by the
+ * timer migration hierarchy. base->expiring keeps the two from running
+ * the same base concurrently.
  */
 static inline void __run_timers(struct timer_base *base)
 {
@@ -1771,6 +1899,10 @@ static inline void __run_timers(struct timer_base *base)
 	timer_base_lock_expiry(base);
 	raw_spin_lock_irq(&base->lock);
 
+	if (base->expiring)
+		goto out_unlock;
+	base->expiring = true;
+
 	while (time_after_eq(jiffies, base->clk) &&
 	       time_after_eq(jiffies, base->next_expiry)) {
 		levels = collect_expired_timers(base, heads);
@@ -1789,10 +1921,40 @@ static inline void __run_timers(struct timer_base *base)
 		while (levels--)
 			expire_timers(base, heads + levels);
 	}
+
+	base->expiring = false;
+out_unlock:
 	raw_spin_unlock_irq(&base->lock);
 	timer_base_unlock_expiry(base);
 }
 
+#ifdef CONFIG_TIMER_MIGRATION
+/**
+ * timer_expire_remote - expire the global timers of an idle CPU
+ * @cpu:	the idle CPU whose BASE_GLOBAL timers are due
+ * @nextexp:	returns the next expiry of that base, if any timer is left
+ *
+ * Called by the timer migration hierarchy from the softirq of the CPU which
+ * acts as migrator. Returns true when @cpu has timers pending afterwards.
+ */
+bool timer_expire_remote(unsigned int cpu, unsigned long *nextexp)
+{
+	struct timer_base *base = per_cpu_ptr(&timer_bases[BASE_GLOBAL], cpu);
+	bool pending;
+
+	__run_timers(base);
+
+	raw_spin_lock_irq(&base->lock);
+	if (base->next_expiry_recalc)
+		base->next_expiry = __next_timer_interrupt(base);
+	*nextexp = base->next_expiry;
+	pending = base->timers_pending;
+	raw_spin_unlock_irq(&base->lock);
+
+	return pending;
+}
+#endif
+
 /*
  * This function runs timers and the timer-tq in bottom half context.
  */
@@ -1801,8 +1963,11 @@ static __latent_entropy void run_timer_softirq(struct softirq_action *h)
 	struct timer_base *base = this_cpu_ptr(&timer_bases[BASE_STD]);
 
 	__run_timers(base);
-	if (IS_ENABLED(CONFIG_NO_HZ_COMMON))
+	if (IS_ENABLED(CONFIG_NO_HZ_COMMON)) {
+		__run_timers(this_cpu_ptr(&timer_bases[BASE_GLOBAL]));
 		__run_timers(this_cpu_ptr(&timer_bases[BASE_DEF]));
+		tmigr_handle_remote();
+	}
 }
 
 /*
@@ -1811,18 +1976,22 @@ static __latent_entropy void run_timer_softirq(struct softirq_action *h)
 static void run_local_timers(void)
 {
 	struct timer_base *base = this_cpu_ptr(&timer_bases[BASE_STD]);
+	int i;
 
 	hrtimer_run_queues();
-	/* Raise the softirq only if required. */
-	if (time_before(jiffies, base->next_expiry)) {
-		if (!IS_ENABLED(CONFIG_NO_HZ_COMMON))
-			return;
-		/* CPU is awake, so check the deferrable base. */
-		base++;
-		if (time_before(jiffies, base->next_expiry))
+
+	/*
+	 * Raise the softirq only if required. The CPU is awake, so check
+	 * all its bases and whether it has to expire global timers on
+	 * behalf of idle CPUs.
+	 */
+	for (i = 0; i < NR_BASES; i++, base++) {
+		if (time_after_eq(jiffies, base->next_expiry) ||
+		    (i == BASE_DEF && tmigr_requires_handle_remote())) {
+			raise_softirq(TIMER_SOFTIRQ);
 			return;
+		}
 	}
-	raise_softirq(TIMER_SOFTIRQ);
 }
 
 /*
@@ -137,6 +137,9 @@ static void print_cpu(struct seq_file *m, int cpu, u64 now)
 	P(nr_hangs);
 	P(max_hang_time);
 #endif
+	P(nr_reprograms);
+	P(nr_coalesced);
+	P(nr_expired);
 #undef P
 #undef P_ns
 
@@ -163,6 +166,8 @@ static void print_cpu(struct seq_file *m, int cpu, u64 now)
 		P(last_jiffies);
 		P(next_timer);
 		P_ns(idle_expires);
+		P(full_ticks);
+		P(full_kicks);
 		SEQ_printf(m, "jiffies: %Lu\n",
 			   (unsigned long long)jiffies);
 	}
@@ -256,7 +261,7 @@ static void timer_list_show_tickdevices_header(struct seq_file *m)
 
 static inline void timer_list_header(struct seq_file *m, u64 now)
 {
-	SEQ_printf(m, "Timer List Version: v0.9\n");
+	SEQ_printf(m, "Timer List Version: v0.11\n");
 	SEQ_printf(m, "HRTIMER_MAX_CLOCK_BASES: %d\n", HRTIMER_MAX_CLOCK_BASES);
 	SEQ_printf(m, "now at %Ld nsecs\n", (unsigned long long)now);
 	SEQ_printf(m, "\n");
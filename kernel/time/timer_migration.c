@@ -0,0 +1,528 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Infrastructure for migratable timers
+ *
+ * Timers which are not pinned to a CPU are queued on the global timer base
+ * of the local CPU. While the CPU is busy it expires them itself. When it
+ * goes idle, it hands the first event of its global base over to the timer
+ * migration hierarchy instead of programming its clock event device for it.
+ *
+ * The hierarchy is a tree of groups which follows the topology: CPUs are the
+ * children of level 0 groups, which are the children of level 1 groups and
+ * so on. Up to tmigr_crossnode_level the groups only contain children of a
+ * single NUMA node, above they span nodes. Every group holds at most
+ * TMIGR_CHILDREN_PER_GROUP children.
+ *
+ * In each group with at least one active child, one of the active children
+ * is the migrator. It takes care of the events of the idle children of the
+ * group. A CPU is the migrator of a higher level group when it is the
+ * migrator of all groups on the way up to it, so every active CPU only
+ * looks at the groups it is responsible for from its tick.
+ *
+ * The events of a group with no active child at all are propagated to its
+ * parent. When the whole hierarchy is idle, the CPU which went idle last is
+ * handed the first event of the top level group and is the only one which
+ * has to wake up for it; all other idle CPUs only wake up for their pinned
+ * timers.
+ *
+ * Locking: each group has its own lock. When the state of a child group is
+ * propagated, the parent lock is taken first and the child lock nested
+ * inside, so the parent always copies the current state of the child and
+ * concurrent walks cannot leave a stale view behind. No path takes a parent
+ * lock while holding a child lock.
+ */
+
+#include <linux/cpuhotplug.h>
+#include <linux/log2.h>
+#include <linux/sched/isolation.h>
+#include <linux/sched/nohz.h>
+#include <linux/slab.h>
+#include <linux/smp.h>
+#include <linux/spinlock.h>
+#include <linux/timer.h>
+
+#include "timer_migration.h"
+#include "tick-internal.h"
+
+static DEFINE_MUTEX(tmigr_mutex);
+static struct list_head *tmigr_level_list __read_mostly;
+
+static unsigned int tmigr_hierarchy_levels __read_mostly;
+static unsigned int tmigr_crossnode_level __read_mostly;
+static struct tmigr_group *tmigr_root __read_mostly;
+
+static DEFINE_PER_CPU(struct tmigr_cpu, tmigr_cpu);
+
+static void tmigr_group_recalc(struct tmigr_group *group)
+{
+	unsigned long pending = group->pending;
+	unsigned long next = 0;
+	bool first = true;
+	unsigned int i;
+
+	for_each_set_bit(i, &pending, TMIGR_CHILDREN_PER_GROUP) {
+		if (first || time_before(group->child_expiry[i], next))
+			next = group->child_expiry[i];
+		first = false;
+	}
+	group->next_expiry = next;
+}
+
+/*
+ * Update the view @group has of the child identified by @childmask. Must be
+ * called with group->lock held.
+ */
+static void tmigr_set_child(struct tmigr_group *group, u8 childmask,
+			    bool active, bool pending, unsigned long expiry)
+{
+	if (active) {
+		group->active |= childmask;
+		if (!group->migrator)
+			group->migrator = childmask;
+	} else {
+		group->active &= ~childmask;
+		/* Hand the migrator duty over to another active child */
+		if (group->migrator == childmask)
+			group->migrator = group->active ?
+					  BIT(__ffs(group->active)) : 0;
+	}
+
+	if (pending) {
+		group->pending |= childmask;
+		group->child_expiry[__ffs(childmask)] = expiry;
+	} else {
+		group->pending &= ~childmask;
+	}
+	tmigr_group_recalc(group);
+}
+
+/* Copy the current state of @child into @group, group->lock held */
+static void tmigr_sync_child(struct tmigr_group *group,
+			     struct tmigr_group *child)
+{
+	unsigned long expiry;
+	bool active, pending;
+
+	raw_spin_lock_nested(&child->lock, SINGLE_DEPTH_NESTING);
+	active = child->active;
+	pending = child->pending;
+	expiry = child->next_expiry;
+	raw_spin_unlock(&child->lock);
+
+	/* The events of an active group are handled by its own migrator */
+	tmigr_set_child(group, child->childmask, active, !active && pending,
+			expiry);
+}
+
+/*
+ * Propagate the state of @group up the hierarchy. The walk ends at the first
+ * group which stays active, as the groups above do not care about the events
+ * below an active group. Must be called with interrupts disabled.
+ *
+ * Returns true when the top level group is idle, with its first event in
+ * @pending and @expiry.
+ */
+static bool tmigr_walk_up(struct tmigr_group *group, bool *pending,
+			  unsigned long *expiry)
+{
+	struct tmigr_group *parent;
+	bool was_active, idle;
+
+	while ((parent = group->parent)) {
+		raw_spin_lock(&parent->lock);
+		was_active = parent->active;
+		tmigr_sync_child(parent, group);
+		if (was_active && parent->active) {
+			raw_spin_unlock(&parent->lock);
+			return false;
+		}
+		raw_spin_unlock(&parent->lock);
+		group = parent;
+	}
+
+	raw_spin_lock(&group->lock);
+	idle = !group->active;
+	*pending = group->pending;
+	*expiry = group->next_expiry;
+	raw_spin_unlock(&group->lock);
+
+	return idle;
+}
+
+/**
+ * tmigr_cpu_activate - take the global timers back from the hierarchy
+ *
+ * Called with interrupts disabled when the CPU leaves idle.
+ */
+void tmigr_cpu_activate(void)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+	struct tmigr_group *group = tmc->tmgroup;
+	unsigned long expiry;
+	bool was_active, pending;
+
+	if (!tmc->online || !tmc->idle)
+		return;
+
+	tmc->idle = false;
+	tmc->wakeup_pending = false;
+
+	raw_spin_lock(&group->lock);
+	was_active = group->active;
+	tmigr_set_child(group, tmc->childmask, true, false, 0);
+	raw_spin_unlock(&group->lock);
+
+	if (!was_active)
+		tmigr_walk_up(group, &pending, &expiry);
+}
+
+/**
+ * tmigr_cpu_deactivate - hand the global timers over to the hierarchy
+ * @pending:	the CPU has a global timer pending
+ * @nextexp:	jiffies of the first global timer of the CPU
+ * @wakeup:	returns the jiffies at which the CPU has to wake up
+ *
+ * Called with interrupts disabled when the CPU goes idle. It may be called
+ * again while the CPU is idle to update its event.
+ *
+ * Returns true when the CPU has to wake up at @wakeup for the hierarchy.
+ * That is the case when the whole hierarchy went idle and this CPU has to
+ * take care of its first event, or when the CPU is not part of the
+ * hierarchy and keeps its own global timers.
+ */
+bool tmigr_cpu_deactivate(bool pending, unsigned long nextexp,
+			  unsigned long *wakeup)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+	struct tmigr_group *group = tmc->tmgroup;
+	bool was_active, top = false;
+	unsigned long expiry = 0;
+
+	if (!tmc->online) {
+		*wakeup = nextexp;
+		return pending;
+	}
+
+	tmc->idle = true;
+
+	raw_spin_lock(&group->lock);
+	was_active = group->active;
+	tmigr_set_child(group, tmc->childmask, false, pending, nextexp);
+	if (!was_active || !group->active) {
+		raw_spin_unlock(&group->lock);
+		top = tmigr_walk_up(group, &pending, &expiry);
+	} else {
+		raw_spin_unlock(&group->lock);
+	}
+
+	tmc->wakeup_pending = top && pending;
+	tmc->wakeup = expiry;
+	if (!tmc->wakeup_pending)
+		return false;
+
+	*wakeup = expiry;
+	return true;
+}
+
+/*
+ * Expire the events of @group which are due at @now. Events of idle child
+ * groups are handled recursively, the global timers of idle CPUs are expired
+ * remotely. Called from softirq context with interrupts enabled.
+ */
+static void tmigr_handle_group(struct tmigr_group *group, unsigned long now)
+{
+	unsigned long pending, expiry, handled = 0;
+	struct tmigr_group *child;
+	unsigned int i;
+	bool more;
+
+	for (;;) {
+		raw_spin_lock_irq(&group->lock);
+		pending = group->pending & ~handled;
+		for_each_set_bit(i, &pending, TMIGR_CHILDREN_PER_GROUP) {
+			if (time_after_eq(now, group->child_expiry[i]))
+				break;
+		}
+		if (i >= TMIGR_CHILDREN_PER_GROUP) {
+			raw_spin_unlock_irq(&group->lock);
+			return;
+		}
+
+		/* Claim the event so no other migrator handles it as well */
+		group->pending &= ~BIT(i);
+		tmigr_group_recalc(group);
+		raw_spin_unlock_irq(&group->lock);
+
+		/* Each child once, its event might not move forward */
+		handled |= BIT(i);
+
+		if (!group->level) {
+			more = timer_expire_remote(group->cpus[i], &expiry);
+
+			raw_spin_lock_irq(&group->lock);
+			/*
+			 * A CPU which became active takes care of itself. One
+			 * which reported its event again meanwhile, through
+			 * tmigr_cpu_deactivate(), has a more recent one than
+			 * @expiry.
+			 */
+			if (more && !(group->active & BIT(i)) &&
+			    !(group->pending & BIT(i))) {
+				group->pending |= BIT(i);
+				group->child_expiry[i] = expiry;
+				tmigr_group_recalc(group);
+			}
+			raw_spin_unlock_irq(&group->lock);
+		} else {
+			child = group->children[i];
+			tmigr_handle_group(child, now);
+
+			raw_spin_lock_irq(&group->lock);
+			tmigr_sync_child(group, child);
+			raw_spin_unlock_irq(&group->lock);
+		}
+	}
+}
+
+/**
+ * tmigr_handle_remote - expire the global timers of idle CPUs
+ *
+ * Called from the timer softirq. An active CPU handles the groups it is the
+ * migrator of. An idle CPU which was woken up for the first event of the
+ * idle hierarchy handles the top level group.
+ */
+void tmigr_handle_remote(void)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+	struct tmigr_group *group, *root;
+	unsigned long now = jiffies;
+	u8 childmask;
+
+	if (!tmc->online)
+		return;
+
+	if (tmc->idle) {
+		if (!tmc->wakeup_pending || time_before(now, tmc->wakeup))
+			return;
+		tmc->wakeup_pending = false;
+
+		/* Somebody became active meanwhile and is in charge now */
+		root = READ_ONCE(tmigr_root);
+		if (!READ_ONCE(root->active))
+			tmigr_handle_group(root, now);
+		return;
+	}
+
+	childmask = tmc->childmask;
+	for (group = tmc->tmgroup; group; group = group->parent) {
+		if (READ_ONCE(group->migrator) != childmask)
+			break;
+		tmigr_handle_group(group, now);
+		childmask = group->childmask;
+	}
+}
+
+/**
+ * tmigr_requires_handle_remote - check for due events of idle CPUs
+ *
+ * Called from the tick with interrupts disabled. Lockless, a stale view only
+ * results in a pointless or a one tick late softirq.
+ */
+bool tmigr_requires_handle_remote(void)
+{
+	struct tmigr_cpu *tmc = this_cpu_ptr(&tmigr_cpu);
+	unsigned long now = jiffies;
+	struct tmigr_group *group;
+	u8 childmask;
+
+	if (!tmc->online)
+		return false;
+
+	if (tmc->idle)
+		return tmc->wakeup_pending && time_after_eq(now, tmc->wakeup);
+
+	childmask = tmc->childmask;
+	for (group = tmc->tmgroup; group; group = group->parent) {
+		if (READ_ONCE(group->migrator) != childmask)
+			break;
+		if (READ_ONCE(group->pending) &&
+		    time_after_eq(now, READ_ONCE(group->next_expiry)))
+			return true;
+		childmask = group->childmask;
+	}
+	return false;
+}
+
+static struct tmigr_group *tmigr_get_group(int node, unsigned int lvl)
+{
+	struct tmigr_group *group, *parent;
+
+	lockdep_assert_held(&tmigr_mutex);
+
+	if (lvl >= tmigr_crossnode_level)
+		node = NUMA_NO_NODE;
+
+	list_for_each_entry(group, &tmigr_level_list[lvl], list) {
+		if (group->numa_node == node &&
+		    group->num_children < TMIGR_CHILDREN_PER_GROUP)
+			return group;
+	}
+
+	group = kzalloc_node(sizeof(*group), GFP_KERNEL, node);
+	if (!group)
+		return ERR_PTR(-ENOMEM);
+
+	raw_spin_lock_init(&group->lock);
+	group->level = lvl;
+	group->numa_node = node;
+
+	if (lvl < tmigr_hierarchy_levels - 1) {
+		parent = tmigr_get_group(node, lvl + 1);
+		if (IS_ERR(parent)) {
+			kfree(group);
+			return parent;
+		}
+
+		raw_spin_lock_irq(&parent->lock);
+		group->parent = parent;
+		group->childmask = BIT(parent->num_children);
+		parent->children[parent->num_children++] = group;
+		raw_spin_unlock_irq(&parent->lock);
+	} else {
+		WARN_ON_ONCE(tmigr_root);
+		WRITE_ONCE(tmigr_root, group);
+	}
+
+	list_add(&group->list, &tmigr_level_list[lvl]);
+	return group;
+}
+
+static int tmigr_cpu_setup(unsigned int cpu)
+{
+	struct tmigr_cpu *tmc = per_cpu_ptr(&tmigr_cpu, cpu);
+	struct tmigr_group *group;
+
+	/* Already part of the hierarchy from an earlier online phase */
+	if (tmc->tmgroup)
+		return 0;
+
+	mutex_lock(&tmigr_mutex);
+	group = tmigr_get_group(cpu_to_node(cpu), 0);
+	if (!IS_ERR(group)) {
+		raw_spin_lock_irq(&group->lock);
+		tmc->childmask = BIT(group->num_children);
+		group->cpus[group->num_children++] = cpu;
+		raw_spin_unlock_irq(&group->lock);
+		tmc->tmgroup = group;
+	}
+	mutex_unlock(&tmigr_mutex);
+
+	return PTR_ERR_OR_ZERO(group);
+}
+
+static int tmigr_cpu_online(unsigned int cpu)
+{
+	struct tmigr_cpu *tmc = per_cpu_ptr(&tmigr_cpu, cpu);
+	int ret;
+
+	/*
+	 * Isolated CPUs must not become migrators and expire the timers of
+	 * others. They stay out of the hierarchy; their own global timers
+	 * are queued on housekeeping CPUs in the first place.
+	 */
+	if (!housekeeping_cpu(cpu, HK_TYPE_TIMER))
+		return 0;
+
+	ret = tmigr_cpu_setup(cpu);
+	if (ret) {
+		/* The CPU keeps and expires its global timers itself */
+		pr_warn("Timer migration setup failed for CPU%u: %d\n", cpu, ret);
+		return 0;
+	}
+
+	local_irq_disable();
+	tmc->idle = true;
+	tmc->online = true;
+	tmigr_cpu_activate();
+	local_irq_enable();
+
+	return 0;
+}
+
+static int tmigr_cpu_offline(unsigned int cpu)
+{
+	struct tmigr_cpu *tmc = per_cpu_ptr(&tmigr_cpu, cpu);
+	unsigned long wakeup;
+	unsigned int target;
+	bool promise;
+
+	if (!tmc->online)
+		return 0;
+
+	/*
+	 * The global timers of the outgoing CPU are moved away by
+	 * timers_dead_cpu(), so it leaves without an event of its own.
+	 */
+	local_irq_disable();
+	promise = tmigr_cpu_deactivate(false, 0, &wakeup);
+	tmc->online = false;
+	tmc->wakeup_pending = false;
+	local_irq_enable();
+
+	/* Another CPU has to take over the first event of the hierarchy */
+	if (promise) {
+		target = cpumask_any_but(cpu_online_mask, cpu);
+		if (target < nr_cpu_ids)
+			wake_up_nohz_cpu(target);
+	}
+
+	return 0;
+}
+
+static int __init tmigr_init(void)
+{
+	unsigned int cpulvl, nodelvl, i;
+	int ret;
+
+	BUILD_BUG_ON_NOT_POWER_OF_2(TMIGR_CHILDREN_PER_GROUP);
+	BUILD_BUG_ON(TMIGR_CHILDREN_PER_GROUP > BITS_PER_TYPE(u8));
+
+	/*
+	 * Enough levels to hold all CPUs below the node crossing level and
+	 * all nodes above it, so the top level is a single group.
+	 */
+	cpulvl = DIV_ROUND_UP(order_base_2(nr_cpu_ids),
+			      ilog2(TMIGR_CHILDREN_PER_GROUP));
+	cpulvl = max(cpulvl, 1U);
+	nodelvl = DIV_ROUND_UP(order_base_2(nr_node_ids),
+			       ilog2(TMIGR_CHILDREN_PER_GROUP));
+
+	tmigr_hierarchy_levels = cpulvl + nodelvl;
+	tmigr_crossnode_level = cpulvl;
+
+	tmigr_level_list = kcalloc(tmigr_hierarchy_levels,
+				   sizeof(struct list_head), GFP_KERNEL);
+	if (!tmigr_level_list) {
+		ret = -ENOMEM;
+		goto err;
+	}
+
+	for (i = 0; i < tmigr_hierarchy_levels; i++)
+		INIT_LIST_HEAD(&tmigr_level_list[i]);
+
+	pr_info("Timer migration: %u hierarchy levels; %u children per group; %u crossnode level\n",
+		tmigr_hierarchy_levels, TMIGR_CHILDREN_PER_GROUP,
+		tmigr_crossnode_level);
+
+	ret = cpuhp_setup_state(CPUHP_AP_ONLINE_DYN, "tmigr:online",
+				tmigr_cpu_online, tmigr_cpu_offline);
+	if (ret < 0)
+		goto err;
+
+	return 0;
+
+err:
+	pr_err("Timer migration setup failed\n");
+	return ret;
+}
+early_initcall(tmigr_init);
@@ -0,0 +1,70 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+#ifndef _KERNEL_TIME_MIGRATION_H
+#define _KERNEL_TIME_MIGRATION_H
+
+/* Per group capacity. Must be less than or equal to BITS_PER_TYPE(u8) */
+#define TMIGR_CHILDREN_PER_GROUP	8
+
+/**
+ * struct tmigr_group - timer migration hierarchy group
+ * @lock:		Protects the group state
+ * @parent:		Pointer to the parent group, NULL for the top level group
+ * @level:		Hierarchy level of the group; CPUs are children of
+ *			level 0 groups
+ * @numa_node:		NUMA node the group belongs to, NUMA_NO_NODE above
+ *			the node crossing level
+ * @num_children:	Number of children connected to the group
+ * @childmask:		Bit of the group in the @active and @pending masks of
+ *			its parent
+ * @active:		Mask of the children which are active
+ * @migrator:		Bit of the active child which expires the events of
+ *			the idle children, 0 if the whole group is idle
+ * @pending:		Mask of the idle children with a pending event
+ * @next_expiry:	First event of the group in jiffies, valid when
+ *			@pending is not empty
+ * @child_expiry:	Event of each pending child in jiffies
+ * @cpus:		CPU numbers of the children of a level 0 group
+ * @children:		Child groups of a group above level 0
+ * @list:		List head which is added to the per level group list
+ */
+struct tmigr_group {
+	raw_spinlock_t		lock;
+	struct tmigr_group	*parent;
+	unsigned int		level;
+	int			numa_node;
+	unsigned int		num_children;
+	u8			childmask;
+	u8			active;
+	u8			migrator;
+	u8			pending;
+	unsigned long		next_expiry;
+	unsigned long		child_expiry[TMIGR_CHILDREN_PER_GROUP];
+	union {
+		unsigned int		cpus[TMIGR_CHILDREN_PER_GROUP];
+		struct tmigr_group	*children[TMIGR_CHILDREN_PER_GROUP];
+	};
+	struct list_head	list;
+};
+
+/**
+ * struct tmigr_cpu - timer migration per CPU state
+ * @online:		Indicates whether the CPU takes part in the hierarchy
+ * @idle:		Indicates whether the CPU has handed its global timers
+ *			over to the hierarchy
+ * @wakeup_pending:	The CPU was the last one to go idle and has to wake
+ *			up at @wakeup for the first event of the hierarchy
+ * @childmask:		Bit of the CPU in the masks of its level 0 group
+ * @wakeup:		Jiffies at which the idle CPU has to handle the top
+ *			level group
+ * @tmgroup:		Level 0 group the CPU belongs to
+ */
+struct tmigr_cpu {
+	bool			online;
+	bool			idle;
+	bool			wakeup_pending;
+	u8			childmask;
+	unsigned long		wakeup;
+	struct tmigr_group	*tmgroup;
+};
+
+#endif
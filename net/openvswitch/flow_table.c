@@ -231,7 +231,7 @@ static struct mask_array *tbl_mask_array_alloc(int size)
 					     size);
 
 	new->masks_usage_stats = __alloc_percpu(sizeof(struct mask_array_stats) +
-						sizeof(u64) * size,
+						sizeof(u64) * size * 2,
 						__alignof__(u64));
 	if (!new->masks_usage_stats) {
 		kfree(new);
@@ -410,6 +410,105 @@ int ovs_flow_tbl_masks_cache_resize(struct flow_table *table, u32 size)
 	return 0;
 }
 
+/* Shared by all tables while their microflow cache is disabled. */
+static struct microflow_cache microflow_cache_disabled;
+
+static void microflow_cache_rcu_cb(struct rcu_head *rcu)
+{
+	struct microflow_cache *mfc;
+
+	mfc = container_of(rcu, struct microflow_cache, rcu);
+	free_percpu(mfc->entries);
+	kfree(mfc);
+}
+
+static void tbl_microflow_cache_free(struct microflow_cache *mfc)
+{
+	if (mfc != &microflow_cache_disabled)
+		call_rcu(&mfc->rcu, microflow_cache_rcu_cb);
+}
+
+static struct microflow_cache *tbl_microflow_cache_alloc(u32 size)
+{
+	struct microflow_cache *new;
+
+	if (!size)
+		return &microflow_cache_disabled;
+
+	new = kzalloc(sizeof(*new), GFP_KERNEL);
+	if (!new)
+		return NULL;
+
+	new->cache_size = size;
+	new->entries = __alloc_percpu(array_size(sizeof(struct microflow_cache_entry),
+						 size),
+				      __alignof__(struct microflow_cache_entry));
+	if (!new->entries) {
+		kfree(new);
+		return NULL;
+	}
+	return new;
+}
+
+int ovs_flow_tbl_microflow_cache_resize(struct flow_table *table, u32 size)
+{
+	struct microflow_cache *mfc = ovsl_dereference(table->microflow_cache);
+	struct microflow_cache *new;
+
+	if (size == mfc->cache_size)
+		return 0;
+
+	/* Only allow size to be 0, or a power of 2, and does not exceed
+	 * percpu allocation size.
+	 */
+	if ((!is_power_of_2(size) && size != 0) ||
+	    (size * sizeof(struct microflow_cache_entry)) > PCPU_MIN_UNIT_SIZE)
+		return -EINVAL;
+
+	new = tbl_microflow_cache_alloc(size);
+	if (!new)
+		return -ENOMEM;
+
+	rcu_assign_pointer(table->microflow_cache, new);
+	tbl_microflow_cache_free(mfc);
+
+	return 0;
+}
+
+u32 ovs_flow_tbl_microflow_cache_size(const struct flow_table *table)
+{
+	struct microflow_cache *mfc = rcu_dereference_ovsl(table->microflow_cache);
+
+	return READ_ONCE(mfc->cache_size);
+}
+
+/* Must be called with OVS mutex held, after a flow was linked into or
+ * unlinked from the table. Microflow cache entries tagged with an older
+ * generation are ignored from then on.
+ */
+static void tbl_flow_gen_bump(struct flow_table *table)
+{
+	u32 gen = table->flow_gen + 1;
+
+	if (unlikely(!gen)) {
+		struct microflow_cache *mfc, *new;
+
+		/* Entries from 2^32 generations ago must not come back to
+		 * life: start over with an empty cache, or none at all.
+		 */
+		mfc = ovsl_dereference(table->microflow_cache);
+		new = tbl_microflow_cache_alloc(mfc->cache_size);
+		if (!new)
+			new = &microflow_cache_disabled;
+		rcu_assign_pointer(table->microflow_cache, new);
+		tbl_microflow_cache_free(mfc);
+		gen = 1;
+	}
+
+	/* Pairs with smp_load_acquire() in ovs_flow_tbl_lookup_stats(). */
+	smp_store_release(&table->flow_gen, gen);
+}
+
 int ovs_flow_tbl_init(struct flow_table *table)
 {
 	struct table_instance *ti, *ufid_ti;
@@ -436,9 +535,11 @@ int ovs_flow_tbl_init(struct flow_table *table)
 	rcu_assign_pointer(table->ufid_ti, ufid_ti);
 	rcu_assign_pointer(table->mask_array, ma);
 	rcu_assign_pointer(table->mask_cache, mc);
+	RCU_INIT_POINTER(table->microflow_cache, &microflow_cache_disabled);
 	table->last_rehash = jiffies;
 	table->count = 0;
 	table->ufid_count = 0;
+	table->flow_gen = 1;
 	return 0;
 
 free_ti:
@@ -471,6 +572,7 @@ static void table_instance_flow_free(struct flow_table *table,
 		table->ufid_count--;
 	}
 
+	tbl_flow_gen_bump(table);
 	flow_mask_remove(table, flow->mask);
 }
 
@@ -518,9 +620,11 @@ void ovs_flow_tbl_destroy(struct flow_table *table)
 	struct table_instance *ufid_ti = rcu_dereference_raw(table->ufid_ti);
 	struct mask_cache *mc = rcu_dereference_raw(table->mask_cache);
 	struct mask_array *ma = rcu_dereference_raw(table->mask_array);
+	struct microflow_cache *mfc = rcu_dereference_raw(table->microflow_cache);
 
 	call_rcu(&mc->rcu, mask_cache_rcu_cb);
 	call_rcu(&ma->rcu, mask_array_rcu_cb);
+	tbl_microflow_cache_free(mfc);
 	table_instance_destroy(ti, ufid_ti);
 }
 
@@ -735,9 +839,10 @@ static struct sw_flow *flow_lookup(struct flow_table *tbl,
 				   u32 *index)
 {
 	struct mask_array_stats *stats = this_cpu_ptr(ma->masks_usage_stats);
+	u32 hot[MASK_ARRAY_HOT_MASKS];
 	struct sw_flow *flow;
 	struct sw_flow_mask *mask;
-	int i;
+	int i, h, n_hot;
 
 	if (likely(*index < ma->max)) {
 		mask = rcu_dereference_ovsl(ma->masks[*index]);
@@ -753,11 +858,42 @@ static struct sw_flow *flow_lookup(struct flow_table *tbl,
 		}
 	}
 
+	/* Then the masks this CPU has been hitting the most, which the
+	 * shared order may rank far behind. Take a snapshot, the list can
+	 * be rewritten by ovs_flow_masks_rebalance() at any time.
+	 */
+	n_hot = min_t(int, READ_ONCE(stats->n_hot), MASK_ARRAY_HOT_MASKS);
+	for (h = 0; h < n_hot; h++) {
+		hot[h] = READ_ONCE(stats->hot[h]);
+		if (hot[h] == *index || hot[h] >= ma->max)
+			continue;
+
+		mask = rcu_dereference_ovsl(ma->masks[hot[h]]);
+		if (!mask)
+			continue;
+
+		flow = masked_flow_lookup(ti, key, mask, n_mask_hit);
+		if (flow) {
+			*index = hot[h];
+			u64_stats_update_begin(&stats->syncp);
+			stats->usage_cntrs[*index]++;
+			u64_stats_update_end(&stats->syncp);
+			return flow;
+		}
+	}
+
 	for (i = 0; i < ma->max; i++)  {
 
 		if (i == *index)
 			continue;
 
+		for (h = 0; h < n_hot; h++) {
+			if (i == hot[h])
+				break;
+		}
+		if (h < n_hot)
+			continue;
+
 		mask = rcu_dereference_ovsl(ma->masks[i]);
 		if (unlikely(!mask))
 			break;
@@ -782,11 +918,11 @@ static struct sw_flow *flow_lookup(struct flow_table *tbl,
  * This is per cpu cache and is divided in MC_HASH_SEGS segments.
  * In case of a hash collision the entry is hashed in next segment.
  * */
-struct sw_flow *ovs_flow_tbl_lookup_stats(struct flow_table *tbl,
-					  const struct sw_flow_key *key,
-					  u32 skb_hash,
-					  u32 *n_mask_hit,
-					  u32 *n_cache_hit)
+static struct sw_flow *flow_tbl_lookup_masks(struct flow_table *tbl,
+					     const struct sw_flow_key *key,
+					     u32 skb_hash,
+					     u32 *n_mask_hit,
+					     u32 *n_cache_hit)
 {
 	struct mask_cache *mc = rcu_dereference(tbl->mask_cache);
 	struct mask_array *ma = rcu_dereference(tbl->mask_array);
@@ -846,6 +982,60 @@ struct sw_flow *ovs_flow_tbl_lookup_stats(struct flow_table *tbl,
 	return flow;
 }
 
+static bool microflow_match(const struct sw_flow *flow,
+			    const struct sw_flow_key *key)
+{
+	const struct sw_flow_mask *mask = flow->mask;
+	struct sw_flow_key masked_key;
+
+	ovs_flow_mask_key(&masked_key, key, false, mask);
+	return flow_cmp_masked_key(flow, &masked_key, &mask->range);
+}
+
+/*
+ * The microflow cache remembers the flow the last packet with a given
+ * skb_hash on this CPU matched. A hit still checks the key against the
+ * flow, but skips hashing the masked key and walking the bucket. Entries
+ * are tagged with the table's flow generation, so that a flow is never
+ * used after it was unlinked from the table.
+ */
+struct sw_flow *ovs_flow_tbl_lookup_stats(struct flow_table *tbl,
+					  const struct sw_flow_key *key,
+					  u32 skb_hash,
+					  u32 *n_mask_hit,
+					  u32 *n_cache_hit,
+					  u32 *n_microflow_hit)
+{
+	struct microflow_cache *mfc = rcu_dereference(tbl->microflow_cache);
+	struct microflow_cache_entry *me = NULL;
+	struct sw_flow *flow;
+	u32 hash = 0, gen = 0;
+
+	*n_microflow_hit = 0;
+	if (skb_hash && mfc->cache_size) {
+		hash = key->recirc_id ? jhash_1word(skb_hash, key->recirc_id) :
+					skb_hash;
+		gen = smp_load_acquire(&tbl->flow_gen);
+		me = this_cpu_ptr(mfc->entries) + (hash & (mfc->cache_size - 1));
+		if (me->skb_hash == hash && me->gen == gen &&
+		    microflow_match(me->flow, key)) {
+			*n_mask_hit = 1;
+			*n_cache_hit = 1;
+			*n_microflow_hit = 1;
+			return me->flow;
+		}
+	}
+
+	flow = flow_tbl_lookup_masks(tbl, key, skb_hash, n_mask_hit,
+				     n_cache_hit);
+	if (flow && me) {
+		me->skb_hash = hash;
+		me->gen = gen;
+		me->flow = flow;
+	}
+	return flow;
+}
+
 struct sw_flow *ovs_flow_tbl_lookup(struct flow_table *tbl,
 				    const struct sw_flow_key *key)
 {
@@ -1043,6 +1233,7 @@ static void flow_key_insert(struct flow_table *table, struct sw_flow *flow)
 	ti = ovsl_dereference(table->ti);
 	table_instance_insert(ti, flow);
 	table->count++;
+	tbl_flow_gen_bump(table);
 
 	/* Expand table, if necessary, to make room. */
 	if (table->count > ti->n_buckets)
@@ -1103,6 +1294,70 @@ static int compare_mask_and_count(const void *a, const void *b)
 	return (s64)mc_b->counter - (s64)mc_a->counter;
 }
 
+/* Must be called with OVS mutex held. Picks the masks each CPU used the
+ * most since the last call and installs them as that CPU's hot masks in
+ * @dst. If @dst is a reordered copy of @ma, @order maps the new positions
+ * to the old indices.
+ */
+static void tbl_mask_array_rank_cpus(struct mask_array *ma,
+				     struct mask_array *dst,
+				     const struct mask_count *order,
+				     int masks_entries)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct mask_count hot[MASK_ARRAY_HOT_MASKS];
+		struct mask_array_stats *stats, *dst_stats;
+		int i, k, n_hot = 0;
+		u64 *base;
+
+		stats = per_cpu_ptr(ma->masks_usage_stats, cpu);
+		base = &stats->usage_cntrs[ma->max];
+
+		for (i = 0; i < masks_entries; i++) {
+			unsigned int start;
+			u64 counter, delta;
+
+			do {
+				start = u64_stats_fetch_begin(&stats->syncp);
+				counter = stats->usage_cntrs[i];
+			} while (u64_stats_fetch_retry(&stats->syncp, start));
+
+			delta = counter - base[i];
+			base[i] = counter;
+			if (!delta)
+				continue;
+
+			/* Insertion into the short, descending hot list. */
+			for (k = n_hot; k > 0 && hot[k - 1].counter < delta; k--) {
+				if (k < MASK_ARRAY_HOT_MASKS)
+					hot[k] = hot[k - 1];
+			}
+			if (k < MASK_ARRAY_HOT_MASKS) {
+				hot[k].index = i;
+				hot[k].counter = delta;
+				n_hot = min(n_hot + 1, MASK_ARRAY_HOT_MASKS);
+			}
+		}
+
+		dst_stats = per_cpu_ptr(dst->masks_usage_stats, cpu);
+		for (k = 0; k < n_hot; k++) {
+			int index = hot[k].index;
+
+			if (order) {
+				for (i = 0; i < masks_entries; i++) {
+					if (order[i].index == index)
+						break;
+				}
+				index = i;
+			}
+			WRITE_ONCE(dst_stats->hot[k], index);
+		}
+		WRITE_ONCE(dst_stats->n_hot, n_hot);
+	}
+}
+
 /* Must be called with OVS mutex held. */
 void ovs_flow_masks_rebalance(struct flow_table *table)
 {
@@ -1160,18 +1415,24 @@ void ovs_flow_masks_rebalance(struct flow_table *table)
 	sort(masks_and_count, masks_entries, sizeof(*masks_and_count),
 	     compare_mask_and_count, NULL);
 
-	/* If the order is the same, nothing to do... */
+	/* If the order is the same, nothing to do but to refresh the
+	 * per CPU hot masks.
+	 */
 	for (i = 0; i < masks_entries; i++) {
 		if (i != masks_and_count[i].index)
 			break;
 	}
-	if (i == masks_entries)
+	if (i == masks_entries) {
+		tbl_mask_array_rank_cpus(ma, ma, NULL, masks_entries);
 		goto free_mask_entries;
+	}
 
 	/* Rebuilt the new list in order of usage. */
 	new = tbl_mask_array_alloc(ma->max);
-	if (!new)
+	if (!new) {
+		tbl_mask_array_rank_cpus(ma, ma, NULL, masks_entries);
 		goto free_mask_entries;
+	}
 
 	for (i = 0; i < masks_entries; i++) {
 		int index = masks_and_count[i].index;
@@ -1180,6 +1441,7 @@ void ovs_flow_masks_rebalance(struct flow_table *table)
 			new->masks[new->count++] = ma->masks[index];
 	}
 
+	tbl_mask_array_rank_cpus(ma, new, masks_and_count, masks_entries);
 	rcu_assign_pointer(table->mask_array, new);
 	call_rcu(&ma->rcu, mask_array_rcu_cb);
 
@@ -33,13 +33,38 @@ struct mask_cache {
 	struct mask_cache_entry __percpu *mask_cache;
 };
 
+/* Exact match cache in front of the megaflow lookup. @flow is only valid
+ * while @gen matches flow_table->flow_gen.
+ */
+struct microflow_cache_entry {
+	u32 skb_hash;
+	u32 gen;
+	struct sw_flow *flow;
+};
+
+struct microflow_cache {
+	struct rcu_head rcu;
+	u32 cache_size;  /* Must be ^2 value, 0 when disabled. */
+	struct microflow_cache_entry __percpu *entries;
+};
+
 struct mask_count {
 	int index;
 	u64 counter;
 };
 
+#define MASK_ARRAY_HOT_MASKS	4
+
 struct mask_array_stats {
 	struct u64_stats_sync syncp;
+	/* This CPU's most used masks, tried before the shared order. Set by
+	 * ovs_flow_masks_rebalance() from another CPU.
+	 */
+	int n_hot;
+	u32 hot[MASK_ARRAY_HOT_MASKS];
+	/* usage_cntrs[max] are followed by max counter values at the time
+	 * of the last rebalance, owned by ovs_flow_masks_rebalance().
+	 */
 	u64 usage_cntrs[];
 };
 
@@ -64,9 +89,11 @@ struct flow_table {
 	struct table_instance __rcu *ufid_ti;
 	struct mask_cache __rcu *mask_cache;
 	struct mask_array __rcu *mask_array;
+	struct microflow_cache __rcu *microflow_cache;
 	unsigned long last_rehash;
 	unsigned int count;
 	unsigned int ufid_count;
+	u32 flow_gen;	/* Bumped whenever a flow is added or removed. */
 };
 
 extern struct kmem_cache *flow_stats_cache;
@@ -88,13 +115,16 @@ void ovs_flow_tbl_remove(struct flow_table *table, struct sw_flow *flow);
 int  ovs_flow_tbl_num_masks(const struct flow_table *table);
 u32  ovs_flow_tbl_masks_cache_size(const struct flow_table *table);
 int  ovs_flow_tbl_masks_cache_resize(struct flow_table *table, u32 size);
+u32  ovs_flow_tbl_microflow_cache_size(const struct flow_table *table);
+int  ovs_flow_tbl_microflow_cache_resize(struct flow_table *table, u32 size);
 struct sw_flow *ovs_flow_tbl_dump_next(struct table_instance *table,
 				       u32 *bucket, u32 *idx);
 struct sw_flow *ovs_flow_tbl_lookup_stats(struct flow_table *,
 					  const struct sw_flow_key *,
 					  u32 skb_hash,
 					  u32 *n_mask_hit,
-					  u32 *n_cache_hit);
+					  u32 *n_cache_hit,
+					  u32 *n_microflow_hit);
 struct sw_flow *ovs_flow_tbl_lookup(struct flow_table *,
 				    const struct sw_flow_key *);
 struct sw_flow *ovs_flow_tbl_lookup_exact(struct flow_table *tbl,
@@ -49,6 +49,7 @@ struct worker {
 static struct bench_futex_parameters params = {
 	.nfutexes = 1024,
 	.runtime  = 10,
+	.buckets  = -1,
 };
 
 static const struct option options[] = {
@@ -58,6 +59,7 @@ static const struct option options[] = {
 	OPT_BOOLEAN( 's', "silent",  &params.silent, "Silent mode: do not display data/details"),
 	OPT_BOOLEAN( 'S', "shared",  &params.fshared, "Use shared futexes instead of private ones"),
 	OPT_BOOLEAN( 'm', "mlockall", &params.mlockall, "Lock all current and future memory"),
+	OPT_INTEGER( 'b', "buckets", &params.buckets, "Use a private futex hash of this size (0: grow with threads)"),
 	OPT_END()
 };
 
@@ -161,6 +163,9 @@ int bench_futex_hash(int argc, const char **argv)
 	if (!params.fshared)
 		futex_flag = FUTEX_PRIVATE_FLAG;
 
+	if (params.buckets >= 0 && futex_hash_slots_set(params.buckets))
+		err(EXIT_FAILURE, "prctl(PR_FUTEX_HASH)");
+
 	printf("Run summary [PID %d]: %d threads, each operating on %d [%s] futexes for %d secs.\n\n",
 	       getpid(), params.nthreads, params.nfutexes, params.fshared ? "shared":"private", params.runtime);
 
@@ -241,6 +246,8 @@ int bench_futex_hash(int argc, const char **argv)
 	}
 
 	print_summary();
+	if (params.buckets >= 0)
+		printf("Private futex hash: %d buckets\n", futex_hash_slots_get());
 
 	free(worker);
 	free(cpu);
@@ -0,0 +1,289 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * futex-waitv: Block threads on several futexes each via futex_waitv(2)
+ * and have the main thread fire them one at a time.
+ *
+ * Every worker waits on its own set of futexes, the way an event loop
+ * waits on a set of events. The main thread round-robins over the workers
+ * and, for each one whose previous event was consumed, sets the next futex
+ * of its set and wakes it. This measures the cost of queueing on and
+ * unqueueing from nfutexes hash buckets per wakeup.
+ */
+
+/* For the CLR_() macros */
+#include <string.h>
+#include <pthread.h>
+
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <linux/compiler.h>
+#include <linux/kernel.h>
+#include <linux/zalloc.h>
+#include <sys/time.h>
+#include <sys/mman.h>
+#include <perf/cpumap.h>
+
+#include "../util/stat.h"
+#include <subcmd/parse-options.h>
+#include "bench.h"
+#include "futex.h"
+
+#include <err.h>
+
+static bool done = false;
+static int futex_flag = 0;
+
+struct timeval bench__start, bench__end, bench__runtime;
+static pthread_mutex_t thread_lock;
+static unsigned int threads_starting;
+static struct stats throughput_stats;
+static pthread_cond_t thread_parent, thread_worker;
+
+struct worker {
+	int tid;
+	u_int32_t *futex;
+	struct futex_waitv *waiters;
+	unsigned int next;	/* futex the main thread fires next */
+	pthread_t thread;
+	unsigned long ops;
+};
+
+static struct bench_futex_parameters params = {
+	.nfutexes = 8,
+	.runtime  = 10,
+};
+
+static const struct option options[] = {
+	OPT_UINTEGER('t', "threads", &params.nthreads, "Specify amount of threads"),
+	OPT_UINTEGER('r', "runtime", &params.runtime, "Specify runtime (in seconds)"),
+	OPT_UINTEGER('f', "futexes", &params.nfutexes, "Specify amount of futexes per thread (max 128)"),
+	OPT_BOOLEAN( 's', "silent",  &params.silent, "Silent mode: do not display data/details"),
+	OPT_BOOLEAN( 'S', "shared",  &params.fshared, "Use shared futexes instead of private ones"),
+	OPT_BOOLEAN( 'm', "mlockall", &params.mlockall, "Lock all current and future memory"),
+	OPT_END()
+};
+
+static const char * const bench_futex_waitv_usage[] = {
+	"perf bench futex waitv <options>",
+	NULL
+};
+
+static void *workerfn(void *arg)
+{
+	struct worker *w = (struct worker *) arg;
+	unsigned long ops = w->ops;
+	unsigned int i;
+	int ret;
+
+	pthread_mutex_lock(&thread_lock);
+	threads_starting--;
+	if (!threads_starting)
+		pthread_cond_signal(&thread_parent);
+	pthread_cond_wait(&thread_worker, &thread_lock);
+	pthread_mutex_unlock(&thread_lock);
+
+	while (!done) {
+		ret = futex_waitv(w->waiters, params.nfutexes, NULL, 0);
+		if (ret < 0 && errno != EAGAIN && errno != EINTR) {
+			if (!params.silent)
+				warn("futex_waitv");
+			break;
+		}
+
+		/* consume whatever fired, the return value is just a hint */
+		for (i = 0; i < params.nfutexes; i++) {
+			if (__atomic_exchange_n(&w->futex[i], 0, __ATOMIC_ACQ_REL))
+				ops++;
+		}
+	}
+
+	w->ops = ops;
+	return NULL;
+}
+
+static void toggle_done(int sig __maybe_unused,
+			siginfo_t *info __maybe_unused,
+			void *uc __maybe_unused)
+{
+	/* inform all threads that we're done for the day */
+	done = true;
+	gettimeofday(&bench__end, NULL);
+	timersub(&bench__end, &bench__start, &bench__runtime);
+}
+
+static void fire(struct worker *w)
+{
+	u_int32_t *uaddr = &w->futex[w->next];
+
+	/* the worker hasn't consumed its last event yet */
+	if (__atomic_load_n(uaddr, __ATOMIC_ACQUIRE))
+		return;
+
+	__atomic_store_n(uaddr, 1, __ATOMIC_RELEASE);
+	futex_wake(uaddr, 1, futex_flag);
+	w->next = (w->next + 1) % params.nfutexes;
+}
+
+static void print_summary(void)
+{
+	unsigned long avg = avg_stats(&throughput_stats);
+	double stddev = stddev_stats(&throughput_stats);
+
+	printf("%sAveraged %ld wakeups/sec per thread (+- %.2f%%), total secs = %d\n",
+	       !params.silent ? "\n" : "", avg, rel_stddev_stats(stddev, avg),
+	       (int)bench__runtime.tv_sec);
+}
+
+int bench_futex_waitv(int argc, const char **argv)
+{
+	int ret = 0;
+	cpu_set_t *cpuset;
+	struct sigaction act;
+	unsigned int i, j;
+	pthread_attr_t thread_attr;
+	struct worker *worker = NULL;
+	struct perf_cpu_map *cpu;
+	struct timeval now;
+	int nrcpus;
+	size_t size;
+
+	argc = parse_options(argc, argv, options, bench_futex_waitv_usage, 0);
+	if (argc) {
+		usage_with_options(bench_futex_waitv_usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	/* FUTEX_WAITV_MAX */
+	if (!params.nfutexes || params.nfutexes > 128) {
+		usage_with_options(bench_futex_waitv_usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	cpu = perf_cpu_map__new(NULL);
+	if (!cpu)
+		goto errmem;
+
+	memset(&act, 0, sizeof(act));
+	sigfillset(&act.sa_mask);
+	act.sa_sigaction = toggle_done;
+	sigaction(SIGINT, &act, NULL);
+
+	if (params.mlockall) {
+		if (mlockall(MCL_CURRENT | MCL_FUTURE))
+			err(EXIT_FAILURE, "mlockall");
+	}
+
+	if (!params.nthreads) /* default to the number of CPUs */
+		params.nthreads = perf_cpu_map__nr(cpu);
+
+	worker = calloc(params.nthreads, sizeof(*worker));
+	if (!worker)
+		goto errmem;
+
+	if (!params.fshared)
+		futex_flag = FUTEX_PRIVATE_FLAG;
+
+	printf("Run summary [PID %d]: %d threads, each waiting on %d [%s] futexes for %d secs.\n\n",
+	       getpid(), params.nthreads, params.nfutexes, params.fshared ? "shared":"private", params.runtime);
+
+	init_stats(&throughput_stats);
+	pthread_mutex_init(&thread_lock, NULL);
+	pthread_cond_init(&thread_parent, NULL);
+	pthread_cond_init(&thread_worker, NULL);
+
+	threads_starting = params.nthreads;
+	pthread_attr_init(&thread_attr);
+
+	nrcpus = perf_cpu_map__nr(cpu);
+	cpuset = CPU_ALLOC(nrcpus);
+	BUG_ON(!cpuset);
+	size = CPU_ALLOC_SIZE(nrcpus);
+
+	for (i = 0; i < params.nthreads; i++) {
+		worker[i].tid = i;
+		worker[i].futex = calloc(params.nfutexes, sizeof(*worker[i].futex));
+		worker[i].waiters = calloc(params.nfutexes, sizeof(*worker[i].waiters));
+		if (!worker[i].futex || !worker[i].waiters)
+			goto errmem;
+
+		for (j = 0; j < params.nfutexes; j++) {
+			worker[i].waiters[j].uaddr = (unsigned long)&worker[i].futex[j];
+			worker[i].waiters[j].val = 0;
+			worker[i].waiters[j].flags = FUTEX_32 | futex_flag;
+		}
+
+		CPU_ZERO_S(size, cpuset);
+
+		CPU_SET_S(perf_cpu_map__cpu(cpu, i % perf_cpu_map__nr(cpu)).cpu, size, cpuset);
+		ret = pthread_attr_setaffinity_np(&thread_attr, size, cpuset);
+		if (ret) {
+			CPU_FREE(cpuset);
+			err(EXIT_FAILURE, "pthread_attr_setaffinity_np");
+		}
+		ret = pthread_create(&worker[i].thread, &thread_attr, workerfn,
+				     (void *)(struct worker *) &worker[i]);
+		if (ret) {
+			CPU_FREE(cpuset);
+			err(EXIT_FAILURE, "pthread_create");
+		}
+	}
+	CPU_FREE(cpuset);
+	pthread_attr_destroy(&thread_attr);
+
+	pthread_mutex_lock(&thread_lock);
+	while (threads_starting)
+		pthread_cond_wait(&thread_parent, &thread_lock);
+	pthread_cond_broadcast(&thread_worker);
+	pthread_mutex_unlock(&thread_lock);
+
+	gettimeofday(&bench__start, NULL);
+	while (!done) {
+		for (i = 0; i < params.nthreads; i++)
+			fire(&worker[i]);
+
+		gettimeofday(&now, NULL);
+		if (now.tv_sec - bench__start.tv_sec >= (time_t)params.runtime)
+			toggle_done(0, NULL, NULL);
+	}
+
+	/* kick everybody out of futex_waitv() */
+	for (i = 0; i < params.nthreads; i++) {
+		for (j = 0; j < params.nfutexes; j++) {
+			__atomic_store_n(&worker[i].futex[j], 1, __ATOMIC_RELEASE);
+			futex_wake(&worker[i].futex[j], 1, futex_flag);
+		}
+	}
+
+	for (i = 0; i < params.nthreads; i++) {
+		ret = pthread_join(worker[i].thread, NULL);
+		if (ret)
+			err(EXIT_FAILURE, "pthread_join");
+	}
+
+	/* cleanup & report results */
+	pthread_cond_destroy(&thread_parent);
+	pthread_cond_destroy(&thread_worker);
+	pthread_mutex_destroy(&thread_lock);
+
+	for (i = 0; i < params.nthreads; i++) {
+		unsigned long t = bench__runtime.tv_sec > 0 ?
+			worker[i].ops / bench__runtime.tv_sec : 0;
+		update_stats(&throughput_stats, t);
+		if (!params.silent)
+			printf("[thread %2d] futexes: %p ... %p [ %ld wakeups/sec ]\n",
+			       worker[i].tid, &worker[i].futex[0],
+			       &worker[i].futex[params.nfutexes-1], t);
+
+		zfree(&worker[i].futex);
+		zfree(&worker[i].waiters);
+	}
+
+	print_summary();
+
+	free(worker);
+	perf_cpu_map__put(cpu);
+	return ret;
+errmem:
+	err(EXIT_FAILURE, "calloc");
+}
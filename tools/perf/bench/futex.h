@@ -11,8 +11,29 @@
 #include <unistd.h>
 #include <sys/syscall.h>
 #include <sys/types.h>
+#include <sys/prctl.h>
 #include <linux/futex.h>
 
+#ifndef __NR_futex_waitv
+#define __NR_futex_waitv 449
+#endif
+
+#ifndef FUTEX_32
+#define FUTEX_32 2
+struct futex_waitv {
+	__u64 val;
+	__u64 uaddr;
+	__u32 flags;
+	__u32 __reserved;
+};
+#endif
+
+#ifndef PR_FUTEX_HASH
+#define PR_FUTEX_HASH			65
+# define PR_FUTEX_HASH_SET_SLOTS	1
+# define PR_FUTEX_HASH_GET_SLOTS	2
+#endif
+
 struct bench_futex_parameters {
 	bool silent;
 	bool fshared;
@@ -25,6 +46,7 @@ struct bench_futex_parameters {
 	unsigned int nfutexes;
 	unsigned int nwakes;
 	unsigned int nrequeue;
+	int buckets; /* private hash slots, -1: global hash */
 };
 
 /**
@@ -69,6 +91,21 @@ futex_wait(u_int32_t *uaddr, u_int32_t val, struct timespec *timeout, int opflag
 	return futex_syscall(uaddr, FUTEX_WAIT, val, timeout, NULL, 0, opflags);
 }
 
+/**
+ * futex_waitv() - block on several futexes, wake on any of them
+ * @waiters:	array of futexes to wait on, with their expected values
+ * @nr_waiters:	number of entries in @waiters
+ * @timeout:	absolute timeout against @clockid, or NULL
+ *
+ * Returns the index of the woken futex.
+ */
+static inline int
+futex_waitv(struct futex_waitv *waiters, unsigned int nr_waiters,
+	    struct timespec *timeout, clockid_t clockid)
+{
+	return syscall(__NR_futex_waitv, waiters, nr_waiters, 0, timeout, clockid);
+}
+
 /**
  * futex_wake() - wake one or more tasks blocked on uaddr
  * @nr_wake:	wake up to this many tasks
@@ -143,4 +180,23 @@ futex_cmp_requeue_pi(u_int32_t *uaddr, u_int32_t val, u_int32_t *uaddr2,
 					val, opflags);
 }
 
+/**
+ * futex_hash_slots_set() - set up a private futex hash for this process
+ * @slots:	number of hash buckets, power of two, or 0 to grow with threads
+ *
+ * Must be called before any threads are created.
+ */
+static inline int futex_hash_slots_set(unsigned int slots)
+{
+	return prctl(PR_FUTEX_HASH, PR_FUTEX_HASH_SET_SLOTS, slots, 0, 0);
+}
+
+/**
+ * futex_hash_slots_get() - size of the private futex hash, 0 if none
+ */
+static inline int futex_hash_slots_get(void)
+{
+	return prctl(PR_FUTEX_HASH, PR_FUTEX_HASH_GET_SLOTS, 0, 0, 0);
+}
+
 #endif /* _FUTEX_H */
@@ -0,0 +1,211 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * sample-output: Measure the cost of writing samples to the ring buffer.
+ *
+ * A busy loop is run three times: without any event, with a cpu-clock
+ * sampling event on the running thread and with the same event in
+ * sample_batch mode, which stages the samples and commits them to the ring
+ * buffer in batches. A second thread drains the ring buffer while the loop
+ * runs. The time the loop loses to the event is divided by the number of
+ * samples taken to get the overhead per sample.
+ */
+
+#include <subcmd/parse-options.h>
+#include <linux/perf_event.h>
+#include <linux/time64.h>
+#include <sys/syscall.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <errno.h>
+#include "bench.h"
+
+#include <err.h>
+
+static struct {
+	unsigned int period;
+	unsigned int pages;
+	unsigned long loops;
+} params = {
+	.period = 10000,	/* ns, the minimum cpu-clock period */
+	.pages = 64,
+	.loops = 1000000000,
+};
+
+static const struct option options[] = {
+	OPT_UINTEGER('p', "period", &params.period, "Specify the sample period in ns"),
+	OPT_UINTEGER('m', "mmap-pages", &params.pages, "Specify the number of ring buffer data pages"),
+	OPT_ULONG('l', "loops", &params.loops, "Specify the number of loops"),
+	OPT_END()
+};
+
+static const char * const bench_sample_output_usage[] = {
+	"perf bench sample output <options>",
+	NULL
+};
+
+struct reader {
+	struct perf_event_mmap_page *page;
+	void *data;
+	size_t size;
+	unsigned long samples;
+	unsigned long lost;
+	bool done;
+};
+
+static void drain(struct reader *r)
+{
+	struct perf_event_mmap_page *page = r->page;
+	u64 head = __atomic_load_n(&page->data_head, __ATOMIC_ACQUIRE);
+	u64 tail = page->data_tail;
+
+	while (tail < head) {
+		struct perf_event_header *hdr = r->data + (tail & (r->size - 1));
+
+		if (hdr->type == PERF_RECORD_SAMPLE)
+			r->samples++;
+		else if (hdr->type == PERF_RECORD_LOST) /* header, id, lost */
+			r->lost += *(u64 *)(r->data + ((tail + sizeof(*hdr) + sizeof(u64)) &
+							(r->size - 1)));
+		tail += hdr->size;
+	}
+
+	__atomic_store_n(&page->data_tail, tail, __ATOMIC_RELEASE);
+}
+
+static void *readerfn(void *arg)
+{
+	struct reader *r = arg;
+
+	while (!__atomic_load_n(&r->done, __ATOMIC_ACQUIRE)) {
+		drain(r);
+		usleep(100);
+	}
+	drain(r);
+	return NULL;
+}
+
+static u64 run_loop(void)
+{
+	struct timeval start, stop, diff;
+	volatile unsigned long i;
+
+	gettimeofday(&start, NULL);
+	for (i = 0; i < params.loops; i++)
+		;
+	gettimeofday(&stop, NULL);
+	timersub(&stop, &start, &diff);
+
+	return diff.tv_sec * USEC_PER_SEC + diff.tv_usec;
+}
+
+static u64 run_sampled(bool batch, struct reader *r)
+{
+	struct perf_event_attr attr = { .size = sizeof(attr), };
+	size_t len = (params.pages + 1) * sysconf(_SC_PAGESIZE);
+	pthread_t thread;
+	void *base;
+	u64 usec;
+	int fd;
+
+	attr.type = PERF_TYPE_SOFTWARE;
+	attr.config = PERF_COUNT_SW_CPU_CLOCK;
+	attr.sample_period = params.period;
+	attr.sample_type = PERF_SAMPLE_IP | PERF_SAMPLE_TID | PERF_SAMPLE_TIME;
+	attr.disabled = 1;
+	attr.exclude_kernel = 1;
+	attr.exclude_hv = 1;
+	attr.sample_batch = batch;
+
+	fd = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+	if (fd < 0)
+		err(EXIT_FAILURE, "perf_event_open%s", batch ? " (sample_batch)" : "");
+
+	base = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (base == MAP_FAILED)
+		err(EXIT_FAILURE, "mmap");
+
+	r->page = base;
+	r->data = base + sysconf(_SC_PAGESIZE);
+	r->size = len - sysconf(_SC_PAGESIZE);
+	r->samples = r->lost = 0;
+	r->done = false;
+
+	if (pthread_create(&thread, NULL, readerfn, r))
+		err(EXIT_FAILURE, "pthread_create");
+
+	if (ioctl(fd, PERF_EVENT_IOC_ENABLE, 0))
+		err(EXIT_FAILURE, "ioctl(PERF_EVENT_IOC_ENABLE)");
+	usec = run_loop();
+	/* commits the staged samples */
+	if (ioctl(fd, PERF_EVENT_IOC_DISABLE, 0))
+		err(EXIT_FAILURE, "ioctl(PERF_EVENT_IOC_DISABLE)");
+
+	__atomic_store_n(&r->done, true, __ATOMIC_RELEASE);
+	pthread_join(thread, NULL);
+
+	munmap(base, len);
+	close(fd);
+	return usec;
+}
+
+static double nsec_per_sample(u64 usec, u64 base_usec, struct reader *r)
+{
+	if (!r->samples || usec <= base_usec)
+		return 0;
+
+	return (double)(usec - base_usec) * NSEC_PER_USEC / r->samples;
+}
+
+static void print_result(const char *name, u64 usec, u64 base_usec,
+			 struct reader *r)
+{
+	printf(" %14s: %lu.%03lu [sec], %lu samples/sec, %lu lost",
+	       name, (unsigned long)(usec / USEC_PER_SEC),
+	       (unsigned long)(usec % USEC_PER_SEC / USEC_PER_MSEC),
+	       usec ? (unsigned long)(r->samples * USEC_PER_SEC / usec) : 0,
+	       r->lost);
+	printf(", %.1lf nsecs/sample\n", nsec_per_sample(usec, base_usec, r));
+}
+
+int bench_sample_output(int argc, const char **argv)
+{
+	u64 base_usec, usec, batch_usec;
+	struct reader r, batch_r;
+
+	argc = parse_options(argc, argv, options, bench_sample_output_usage, 0);
+	if (argc || !params.pages || (params.pages & (params.pages - 1))) {
+		usage_with_options(bench_sample_output_usage, options);
+		exit(EXIT_FAILURE);
+	}
+
+	base_usec = run_loop();
+	usec = run_sampled(false, &r);
+	batch_usec = run_sampled(true, &batch_r);
+
+	switch (bench_format) {
+	case BENCH_FORMAT_DEFAULT:
+		printf("# Ran %lu loops sampled every %u ns into %u pages\n\n",
+		       params.loops, params.period, params.pages);
+		printf(" %14s: %lu.%03lu [sec]\n", "No event",
+		       (unsigned long)(base_usec / USEC_PER_SEC),
+		       (unsigned long)(base_usec % USEC_PER_SEC / USEC_PER_MSEC));
+		print_result("Sampled", usec, base_usec, &r);
+		print_result("Batched", batch_usec, base_usec, &batch_r);
+		break;
+	case BENCH_FORMAT_SIMPLE:
+		printf("%.1lf %.1lf\n", nsec_per_sample(usec, base_usec, &r),
+		       nsec_per_sample(batch_usec, base_usec, &batch_r));
+		break;
+	default:
+		fprintf(stderr, "Unknown format: %d\n", bench_format);
+		exit(EXIT_FAILURE);
+	}
+
+	return 0;
+}
@@ -1,10 +1,12 @@
 // SPDX-License-Identifier: LGPL-2.1
 /*
- * Basic test coverage for critical regions and rseq_current_cpu().
+ * Basic test coverage for critical regions, rseq_current_cpu() and
+ * rseq_current_mm_cid().
  */
 
 #define _GNU_SOURCE
 #include <assert.h>
+#include <pthread.h>
 #include <sched.h>
 #include <signal.h>
 #include <stdio.h>
@@ -35,6 +37,48 @@ void test_cpu_pointer(void)
 	sched_setaffinity(0, sizeof(affinity), &affinity);
 }
 
+#define NR_MM_CID_THREADS	16
+
+static void *test_mm_cid_thread(void *arg)
+{
+	uint32_t *mm_cid = arg;
+
+	if (rseq_register_current_thread())
+		abort();
+	*mm_cid = rseq_current_mm_cid();
+	if (rseq_unregister_current_thread())
+		abort();
+	return NULL;
+}
+
+void test_mm_cid(void)
+{
+	uint32_t mm_cid[NR_MM_CID_THREADS];
+	pthread_t threads[NR_MM_CID_THREADS];
+	cpu_set_t affinity;
+	int i, nr_cpus;
+
+	if (!rseq_mm_cid_available()) {
+		printf("mm_cid not available, skipping\n");
+		return;
+	}
+
+	/* The only registered thread always gets the first ID. */
+	assert(rseq_current_mm_cid() == 0);
+
+	sched_getaffinity(0, sizeof(affinity), &affinity);
+	nr_cpus = CPU_COUNT(&affinity);
+	for (i = 0; i < NR_MM_CID_THREADS; i++)
+		assert(!pthread_create(&threads[i], NULL, test_mm_cid_thread,
+				       &mm_cid[i]));
+	for (i = 0; i < NR_MM_CID_THREADS; i++) {
+		assert(!pthread_join(threads[i], NULL));
+		/* The main thread holds an ID as well. */
+		assert(mm_cid[i] < NR_MM_CID_THREADS + 1);
+		assert(mm_cid[i] < nr_cpus);
+	}
+}
+
 int main(int argc, char **argv)
 {
 	if (rseq_register_current_thread()) {
@@ -44,6 +88,8 @@ int main(int argc, char **argv)
 	}
 	printf("testing current cpu\n");
 	test_cpu_pointer();
+	printf("testing current mm_cid\n");
+	test_mm_cid();
 	if (rseq_unregister_current_thread()) {
 		fprintf(stderr, "Error: rseq_unregister_current_thread(...) failed(%d): %s\n",
 			errno, strerror(errno));
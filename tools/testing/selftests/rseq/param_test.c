@@ -1226,6 +1226,25 @@ static int sys_membarrier(int cmd, int flags, int cpu_id)
 	return syscall(__NR_membarrier, cmd, flags, cpu_id);
 }
 
+/*
+ * Restart rseq critical sections on @cpu through a CPU mask which also
+ * selects the neighbouring CPUs of its group of 8. Falls back to
+ * MEMBARRIER_CMD_FLAG_CPU on kernels without MEMBARRIER_CMD_FLAG_CPU_MASK.
+ */
+static int sys_membarrier_rseq_mask(int cpu)
+{
+	int base = cpu & ~7;
+	int flags = MEMBARRIER_CMD_FLAG_CPU_MASK |
+		    (0xff << MEMBARRIER_CMD_FLAG_CPU_MASK_SHIFT);
+
+	if (!sys_membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED_RSEQ, flags, base))
+		return 0;
+	if (errno != EINVAL)
+		return -1;
+	return sys_membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED_RSEQ,
+			      MEMBARRIER_CMD_FLAG_CPU, cpu);
+}
+
 /*
  * The manager thread swaps per-cpu lists that worker threads see,
  * and validates that there are no unexpected modifications.
@@ -1288,8 +1307,7 @@ void *test_membarrier_manager_thread(void *arg)
 
 		/* Make list_a "active". */
 		atomic_store(&args->percpu_list_ptr, (intptr_t)&list_a);
-		if (sys_membarrier(MEMBARRIER_CMD_PRIVATE_EXPEDITED_RSEQ,
-					MEMBARRIER_CMD_FLAG_CPU, cpu_b) &&
+		if (sys_membarrier_rseq_mask(cpu_b) &&
 				errno != ENXIO /* missing CPU*/) {
 			perror("sys_membarrier");
 			abort();
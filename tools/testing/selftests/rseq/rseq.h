@@ -54,6 +54,8 @@ extern ptrdiff_t rseq_offset;
 extern unsigned int rseq_size;
 /* Flags used during rseq registration.  */
 extern unsigned int rseq_flags;
+/* Size of the rseq fields updated by the kernel.  */
+extern unsigned int rseq_feature_size;
 
 static inline struct rseq_abi *rseq_get_abi(void)
 {
@@ -153,6 +155,27 @@ static inline uint32_t rseq_current_cpu(void)
 	return cpu;
 }
 
+/*
+ * The mm_cid field is only updated by kernels which advertise it through
+ * AT_RSEQ_FEATURE_SIZE.
+ */
+static inline bool rseq_mm_cid_available(void)
+{
+	return rseq_feature_size != -1U &&
+	       rseq_feature_size >= offsetof(struct rseq_abi, mm_cid) +
+				    sizeof(__u32);
+}
+
+/*
+ * Returns the concurrency ID of the current thread, which is smaller
+ * than both the number of threads of the process which registered rseq
+ * and the number of CPUs they are allowed to run on.
+ */
+static inline uint32_t rseq_current_mm_cid(void)
+{
+	return RSEQ_ACCESS_ONCE(rseq_get_abi()->mm_cid);
+}
+
 static inline void rseq_clear_rseq_cs(void)
 {
 	RSEQ_WRITE_ONCE(rseq_get_abi()->rseq_cs.arch.ptr, 0);